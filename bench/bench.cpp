@@ -0,0 +1,366 @@
+// small spill segments, so the spill check turns the segment ring over quickly
+#define HISTORY_SPILL_SEGMENT (1024 * 1024)
+
+#include "qonsole/qonsole.hpp"
+#include <QApplication>
+#include <QImage>
+
+#include <stdio.h>
+#include <string.h>
+#include <functional>
+
+// Benchmarks of the parse and render pipelines on canned workloads.
+//
+// usage: qonsole_bench [filter]
+//   only benchmarks whose name contains `filter` are run
+// usage: qonsole_bench --replay <recording>
+//   replays a session recording as fast as possible
+//
+// Runs offscreen unless QT_QPA_PLATFORM says otherwise.
+
+#define WORKLOAD_SIZE (8 * 1024 * 1024)  // Bytes generated per workload
+#define FEED_CHUNK_SIZE 4096             // Bytes per on_data_ready() call, about one pty read
+#define MIN_BENCH_TIME 500               // Milliseconds spent per benchmark at least
+#define SCROLLBACK_BUDGET (16 * 1024 * 1024)  // Bytes of budgeted scrollback for the budget variants
+#define SPILL_DISK_BUDGET (4 * 1024 * 1024)  // Bytes on disk the spill check allows
+
+// exposes the protected pipeline entry points
+class bench_widget : public qonsole::QonsoleWidget {
+    public:
+        bench_widget() : QonsoleWidget(nullptr) {}
+
+        void feed(const QByteArray &data) {
+            on_data_ready(data);
+        }
+
+        void select_all() {
+            int cols, lines;
+            get_terminal_size(cols, lines);
+
+            m_selection = {0, 0, (uint)lines - 1, (uint)cols - 1, false};
+            m_is_selecting = true;
+            update_selection_span();
+        }
+};
+
+// ********************************
+
+static QByteArray workload_ascii() {
+    QByteArray out;
+    const char *words[] = {"lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing", "elit"};
+
+    for (int i = 0; out.size() < WORKLOAD_SIZE; ++i) {
+        QByteArray line;
+        while (line.size() < 72)
+            line += QByteArray(words[(i + line.size()) % 8]) + " ";
+
+        out += line + "\r\n";
+    }
+
+    return out;
+}
+
+// colored `ls` output: short SGR runs between file names
+static QByteArray workload_ls() {
+    QByteArray out;
+    const char *colors[] = {"01;34", "01;32", "00", "01;36", "01;31", "00;33"};
+
+    for (int i = 0; out.size() < WORKLOAD_SIZE; ++i) {
+        for (int col = 0; col < 6; ++col) {
+            out += "\x1b[" + QByteArray(colors[(i + col) % 6]) + "m";
+            out += "file_" + QByteArray::number(i * 6 + col);
+            out += "\x1b[0m  ";
+        }
+
+        out += "\r\n";
+    }
+
+    return out;
+}
+
+// 24-bit color gradients, every cell a different SGR
+static QByteArray workload_truecolor() {
+    QByteArray out;
+
+    for (int i = 0; out.size() < WORKLOAD_SIZE; ++i) {
+        for (int col = 0; col < 80; ++col) {
+            int r = (i * 3 + col) & 0xFF, g = (col * 3) & 0xFF, b = (i * 5) & 0xFF;
+
+            out += "\x1b[38;2;" + QByteArray::number(r) + ";" + QByteArray::number(g) + ";" + QByteArray::number(b);
+            out += ";48;2;" + QByteArray::number(b) + ";" + QByteArray::number(r) + ";" + QByteArray::number(g) + "m#";
+        }
+
+        out += "\x1b[0m\r\n";
+    }
+
+    return out;
+}
+
+// `htop`-like full screen redraws through cursor addressing
+static QByteArray workload_htop(int cols, int lines) {
+    QByteArray out;
+
+    for (int frame = 0; out.size() < WORKLOAD_SIZE; ++frame) {
+        out += "\x1b[H";
+
+        for (int row = 1; row <= lines; ++row) {
+            int bar = (frame * 7 + row * 13) % (cols - 20);
+
+            out += "\x1b[" + QByteArray::number(row) + ";1H";
+            out += "\x1b[1;37m" + QByteArray::number(row).rightJustified(3) + " \x1b[0m[";
+            out += "\x1b[32m" + QByteArray(bar / 2, '|');
+            out += "\x1b[31m" + QByteArray(bar - bar / 2, '|');
+            out += "\x1b[0m" + QByteArray(cols - 20 - bar, ' ') + "]";
+            out += "\x1b[K";
+        }
+    }
+
+    return out;
+}
+
+// wide CJK characters mixed with accented latin and emoji
+static QByteArray workload_utf8() {
+    QByteArray out;
+    QByteArray line = QString::fromUtf8("漢字かなカナ한국어 déjà vu — naïve café 🙂 中文输入法测试").toUtf8();
+
+    while (out.size() < WORKLOAD_SIZE)
+        out += line + "\r\n";
+
+    return out;
+}
+
+// ********************************
+
+struct bench_result {
+    qint64 iterations = 0;
+    qint64 nsecs = 0;
+};
+
+// run fn until MIN_BENCH_TIME elapsed
+static bench_result run_timed(const std::function<void()> &fn) {
+    bench_result r;
+    QElapsedTimer timer;
+    timer.start();
+
+    do {
+        fn();
+        r.iterations++;
+    } while (timer.elapsed() < MIN_BENCH_TIME);
+
+    r.nsecs = timer.nsecsElapsed();
+    return r;
+}
+
+static void report_throughput(const char *name, const bench_result &r, qint64 bytes) {
+    double seconds = r.nsecs / 1e9;
+    printf("%-36s %10.1f MB/s\n", name, (double)bytes * r.iterations / (1024.0 * 1024.0) / seconds);
+}
+
+static void report_time(const char *name, const bench_result &r) {
+    printf("%-36s %10.3f ms\n", name, r.nsecs / 1e6 / r.iterations);
+}
+
+static void vte_write_callback(struct tsm_vte *vte, const char *u8, size_t len, void *data) {
+    Q_UNUSED(vte);
+    Q_UNUSED(u8);
+    Q_UNUSED(len);
+    Q_UNUSED(data);
+}
+
+// raw libtsm throughput, the floor of what the widget can do
+static void bench_vte_input(const char *name, const QByteArray &data) {
+    struct tsm_screen *screen;
+    struct tsm_vte *vte;
+
+    if (tsm_screen_new(&screen, nullptr, nullptr) < 0)
+        return;
+
+    tsm_screen_resize(screen, 80, 24);
+    tsm_screen_set_max_sb(screen, 1000);
+
+    if (tsm_vte_new(&vte, screen, vte_write_callback, nullptr, nullptr, nullptr) < 0) {
+        tsm_screen_unref(screen);
+        return;
+    }
+
+    bench_result r = run_timed([&]() {
+        tsm_vte_input(vte, data.constData(), data.size());
+    });
+    report_throughput(name, r, data.size());
+
+    tsm_vte_unref(vte);
+    tsm_screen_unref(screen);
+}
+
+// the widget's ingestion path, chunked the way a reader delivers output. with a
+// `budget` lines also move out of libtsm into the budgeted scrollback
+static void bench_on_data_ready(const char *name, const QByteArray &data, size_t budget = 0) {
+    bench_widget widget;
+    widget.set_vt_size(80, 24);
+
+    if (budget > 0)
+        widget.set_scrollback_budget(budget);
+
+    std::vector<QByteArray> chunks;
+    for (int i = 0; i < data.size(); i += FEED_CHUNK_SIZE)
+        chunks.push_back(data.mid(i, FEED_CHUNK_SIZE));
+
+    bench_result r = run_timed([&]() {
+        for (const QByteArray &chunk : chunks)
+            widget.feed(chunk);
+    });
+    report_throughput(name, r, data.size());
+}
+
+// full frames painted into an offscreen image
+static void bench_paint(const char *name, int cols, int lines) {
+    bench_widget widget;
+    widget.set_vt_size(cols, lines);
+    widget.widget_fit_vt_size();
+    widget.feed(workload_htop(cols, lines).right(64 * 1024));
+
+    QImage image(widget.size(), QImage::Format_ARGB32_Premultiplied);
+
+    bench_result r = run_timed([&]() {
+        widget.render(&image);
+    });
+    report_time(name, r);
+}
+
+static void bench_text(const char *name, bool selection) {
+    bench_widget widget;
+    widget.set_vt_size(160, 50);
+    widget.feed(workload_utf8().left(256 * 1024));
+    widget.select_all();
+
+    volatile int sink = 0;
+    bench_result r = run_timed([&]() {
+        sink += selection ? widget.get_selected_text().size() : widget.dump_screen().size();
+    });
+    report_time(name, r);
+}
+
+// overnight output through a spilling scrollback: the spill file has to level
+// off at the disk budget instead of growing with the output
+static bool check_spill() {
+    // libtsm's default foreground and background codes
+    tsm_screen_attr attr {};
+    attr.fccode = 16;
+    attr.bccode = 17;
+
+    qonsole::QonsoleScrollback history(256 * 1024, false);
+    history.set_spill(true, QString(), SPILL_DISK_BUDGET);
+
+    uint32_t seed = 1;
+    size_t sizes[2] = {};
+
+    for (int round = 0; round < 2; ++round) {
+        for (int line = 0; line < 100000; ++line) {
+            for (int col = 0; col < 80; ++col) {
+                seed = seed * 1103515245 + 12345;
+                uint32_t ch = 'a' + (seed >> 16) % 26;
+                history.append_cell(&ch, 1, 1, attr);
+            }
+
+            history.end_line();
+        }
+
+        sizes[round] = history.spill_file_size();
+    }
+
+    bool level = sizes[0] > 0 && sizes[1] == sizes[0] && sizes[1] <= SPILL_DISK_BUDGET + 2 * HISTORY_SPILL_SEGMENT;
+    printf("%-36s %10zu / %zu bytes %s\n", "scrollback_spill/file_size", sizes[0], sizes[1], level ? "ok" : "GROWING");
+
+    return level;
+}
+
+// a recording from set_record_file() played back at full speed
+static int bench_replay(const char *path) {
+    bench_widget widget;
+    qonsole::QonsoleReplay replay(widget.terminal());
+
+    if (!replay.open(path)) {
+        fprintf(stderr, "cannot open recording %s\n", path);
+        return 1;
+    }
+
+    QFile file(path);
+    qint64 bytes = file.size();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QObject::connect(&replay, &qonsole::QonsoleReplay::finished, qApp, &QApplication::quit);
+    replay.play(qonsole::FAST_FORWARD);
+    qApp->exec();
+
+    bench_result r;
+    r.iterations = 1;
+    r.nsecs = timer.nsecsElapsed();
+    report_throughput("replay", r, bytes);
+
+    return 0;
+}
+
+// ********************************
+
+int main(int argc, char *argv[]) {
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QApplication app(argc, argv);
+
+    if (argc > 2 && strcmp(argv[1], "--replay") == 0)
+        return bench_replay(argv[2]);
+
+    const char *filter = argc > 1 ? argv[1] : "";
+    auto enabled = [&](const char *name) {
+        return strstr(name, filter) != nullptr;
+    };
+
+    struct {
+        const char *name;
+        QByteArray data;
+    } workloads[] = {
+        {"ascii", workload_ascii()},
+        {"ls", workload_ls()},
+        {"truecolor", workload_truecolor()},
+        {"htop", workload_htop(80, 24)},
+        {"utf8", workload_utf8()},
+    };
+
+    for (const auto &w : workloads) {
+        QByteArray name = QByteArray("vte_input/") + w.name;
+        if (enabled(name.constData()))
+            bench_vte_input(name.constData(), w.data);
+
+        name = QByteArray("on_data_ready/") + w.name;
+        if (enabled(name.constData()))
+            bench_on_data_ready(name.constData(), w.data);
+
+        name = QByteArray("on_data_ready_budget/") + w.name;
+        if (enabled(name.constData()))
+            bench_on_data_ready(name.constData(), w.data, SCROLLBACK_BUDGET);
+    }
+
+    const int sizes[][2] = {{80, 24}, {160, 50}, {240, 80}};
+
+    for (const auto &size : sizes) {
+        QByteArray name = "paint/" + QByteArray::number(size[0]) + "x" + QByteArray::number(size[1]);
+        if (enabled(name.constData()))
+            bench_paint(name.constData(), size[0], size[1]);
+    }
+
+    if (enabled("dump_screen"))
+        bench_text("dump_screen", false);
+
+    if (enabled("get_selected_text"))
+        bench_text("get_selected_text", true);
+
+    bool ok = true;
+
+    if (enabled("scrollback_spill"))
+        ok = check_spill() && ok;
+
+    return ok ? 0 : 1;
+}
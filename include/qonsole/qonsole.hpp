@@ -20,6 +20,13 @@
  * - Terminal size management with automatic PTY notifications (local only)
  * - Thread-safe data reading from file descriptors, pipes, or sockets
  * - Text selection support (framework ready)
+ * - Incremental repaint driven by libtsm cell ages
+ * - Glyph cache: cells are blitted from pre-rendered pixmaps
+ * - Run batching: consecutive cells sharing attributes are painted together
+ * - Coalesced output ingestion through a lock-free ring, repaints capped at display refresh
+ * - Optional dedicated parser thread feeding the vte off the GUI thread
+ * - Shared I/O multiplexer (epoll/kqueue/WSAEventSelect) serving many readers from one thread
+ * - Asynchronous, queued writes with back-pressure reporting
  * 
  * @namespace qonsole
  * 
@@ -28,8 +35,13 @@
  * - q_palette: Color palette definition for terminal colors
  * - q_cursor_pos: Cursor position tracking
  * - q_cursor_style: Cursor appearance enumeration
+ * - q_byte_ring: Lock-free single producer / single consumer byte ring
  * - QonsoleReader: Threaded reader for data input from various sources
- * - QonsoleWidget: Main terminal emulator widget
+ * - QonsoleMultiplexer: Single thread serving many readers through the OS poller
+ * - QonsoleWriter: Threaded writer draining an outgoing queue to the source
+ * - QonsoleParser: Worker feeding reader output to the vte on its own thread
+ * - QonsoleTerminal: Headless terminal owning the reader, writer, parser and screen state
+ * - QonsoleWidget: Main terminal emulator widget, a view onto a QonsoleTerminal
  * 
  * Platform-specific Features:
  * - Unix-like systems: Uses file descriptors and ioctl for PTY control
@@ -39,16 +51,150 @@
 
 #ifndef BUFFER_SIZE
 #define BUFFER_SIZE 1024
-#endif // Bytes
+#endif // Bytes, default read size
+
+#ifndef MAX_BUFFER_SIZE
+#define MAX_BUFFER_SIZE (64 * 1024)
+#endif // Bytes, upper bound of the adaptive read size
 
 #ifndef EMPTY_CELL_REPLACEMENT
 #define EMPTY_CELL_REPLACEMENT " "
 #endif // Bytes
 
+#ifndef RING_BUFFER_SIZE
+#define RING_BUFFER_SIZE (1024 * 1024)
+#endif // Bytes per reader, rounded up to a power of two
+
+#ifndef INGEST_TIME_BUDGET
+#define INGEST_TIME_BUDGET 8
+#endif // Milliseconds spent parsing before yielding to the event loop
+
+#ifndef INGEST_CHUNK_SIZE
+#define INGEST_CHUNK_SIZE (64 * 1024)
+#endif // Bytes handed to the vte at once
+
+#ifndef RING_FULL_WAIT
+#define RING_FULL_WAIT 100
+#endif // Milliseconds a reader with a full ring sleeps at most before re-checking
+
+#ifndef WRITE_CHUNK_SIZE
+#define WRITE_CHUNK_SIZE (16 * 1024)
+#endif // Bytes handed to a single write() by the async writer
+
+#ifndef WRITE_HIGH_WATERMARK
+#define WRITE_HIGH_WATERMARK (1024 * 1024)
+#endif // Bytes queued before the writer reports congestion
+
+#ifndef WRITE_LOW_WATERMARK
+#define WRITE_LOW_WATERMARK (256 * 1024)
+#endif // Bytes queued below which the writer reports it drained
+
+#ifndef WRITE_STALL_WAIT
+#define WRITE_STALL_WAIT 50
+#endif // Milliseconds a writer waits for the source to accept data before checking for stop()
+
+#ifndef GLYPH_CACHE_SIZE
+#define GLYPH_CACHE_SIZE 4096
+#endif // Glyphs, cache is flushed when full
+
+#ifndef ECHO_WINDOW
+#define ECHO_WINDOW 50
+#endif // Milliseconds after a keystroke during which output is presented at once in latency mode
+
+#ifndef FRAME_REQUEST_TIMEOUT
+#define FRAME_REQUEST_TIMEOUT 100
+#endif // Milliseconds to wait for a requested window update before presenting anyway
+
+#ifndef GL_ATLAS_SIZE
+#define GL_ATLAS_SIZE 2048
+#endif // Pixels, side of the OpenGL backend's glyph atlas
+
+#ifndef HISTORY_BLOCK_LINES
+#define HISTORY_BLOCK_LINES 256
+#endif // Lines per scrollback block, full blocks get compressed
+
+#ifndef HISTORY_COMPRESSION_LEVEL
+#define HISTORY_COMPRESSION_LEVEL 1
+#endif // zlib level for sealed scrollback blocks
+
+#ifndef HISTORY_DECODED_BLOCKS
+#define HISTORY_DECODED_BLOCKS 4
+#endif // Scrollback blocks kept decoded for reading
+
+#ifndef HISTORY_SPILL_SEGMENT
+#define HISTORY_SPILL_SEGMENT (64 * 1024 * 1024)
+#endif // Bytes, the spill file grows and is mapped by segments of this size
+
+#ifndef HISTORY_GRAM_BITS
+#define HISTORY_GRAM_BITS 2048
+#endif // Bits of the per block trigram filter used by search, a power of two
+
+#ifndef HISTORY_CAPTURE_LINES
+#define HISTORY_CAPTURE_LINES 4096
+#endif // Lines libtsm may hold before they are moved to the budgeted scrollback
+
+#ifndef RECORD_KEYFRAME_INTERVAL
+#define RECORD_KEYFRAME_INTERVAL (1024 * 1024)
+#endif // Bytes of recorded output between two screen keyframes
+
+#ifndef RECORD_FLUSH_INTERVAL
+#define RECORD_FLUSH_INTERVAL 1000
+#endif // Milliseconds a session recording buffers records before writing them out
+
+#ifndef REPLAY_TIME_BUDGET
+#define REPLAY_TIME_BUDGET 8
+#endif // Milliseconds a fast replay feeds before yielding to the event loop
+
+#ifndef SUSPEND_BUFFER_SIZE
+#define SUSPEND_BUFFER_SIZE (1024 * 1024)
+#endif // Bytes of output a suspended terminal holds back before parsing them
+
+#ifndef SUSPEND_PARSE_INTERVAL
+#define SUSPEND_PARSE_INTERVAL 250
+#endif // Milliseconds output is held back at most, so queries still get their replies
+
+#ifndef PASTE_CHUNK_SIZE
+#define PASTE_CHUNK_SIZE (64 * 1024)
+#endif // Bytes a paste writes per step when there's no writer thread
+
+#ifndef PASTE_RETRY_INTERVAL
+#define PASTE_RETRY_INTERVAL 5
+#endif // Milliseconds before a paste without writer thread retries a full source
+
+#ifndef WHEEL_SCROLL_LINES
+#define WHEEL_SCROLL_LINES 3
+#endif // Lines one wheel notch scrolls
+
+#ifndef SCROLL_ANIMATION_TIME
+#define SCROLL_ANIMATION_TIME 100
+#endif // Milliseconds a wheel notch eases in over
+
+#ifndef SCROLL_FRICTION
+#define SCROLL_FRICTION 4.0
+#endif // Per second decay rate of a kinetic fling's velocity
+
+#ifndef SCROLL_MIN_VELOCITY
+#define SCROLL_MIN_VELOCITY 60.0
+#endif // Pixels per second below which a fling stops, or does not start
+
+#ifndef RESIZE_DEBOUNCE_TIME
+#define RESIZE_DEBOUNCE_TIME 150
+#endif // Milliseconds the size has to stay put before a debounced resize applies
+
 // platform specific includes
 #if defined(__linux__) || defined(__APPLE__)
     #include <unistd.h>     // read, write
     #include <sys/ioctl.h>  // ioctl, winsize
+    #include <cerrno>       // errno
+    #include <poll.h>       // poll
+    #include <fcntl.h>      // fcntl, O_NONBLOCK
+#endif
+
+#if defined(__linux__)
+    #include <sys/epoll.h>   // epoll
+    #include <sys/eventfd.h> // eventfd
+#elif defined(__APPLE__)
+    #include <sys/event.h>  // kqueue
 #elif defined(_WIN32)
     #include <windows.h>    // HANDLE
     #include <winsock2.h>   // SOCKET
@@ -56,61 +202,58 @@
 
 #include <QPainter>
 #include <QColor>
+#include <QFontMetricsF>
 #include <QWidget>
 #include <QScrollArea>
 #include <QVBoxLayout>
 #include <QEvent>
 #include <QKeyEvent>
 #include <QThread>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QScreen>
+#include <QWindow>
+#include <QPointer>
+#include <QMetaMethod>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QHash>
+#include <QPixmap>
+#include <QImage>
+#include <QByteArray>
+#include <QTemporaryFile>
+#include <QFile>
+#include <QRegularExpression>
+#include <QGuiApplication>
+#include <QClipboard>
+#ifdef QONSOLE_OPENGL
+#include <QOpenGLWidget>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLShaderProgram>
+#include <QSurfaceFormat>
+#include <QVector2D>
+#include <QImage>
+#endif
 #include <libtsm.h>
 
+#include <atomic>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+#include <deque>
+#include <string>
+#include <utility>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
 
 
 // ***********************************
 
-#ifdef _WIN32
-    #define ARROW_UP "\x48"
-    #define ARROW_DOWN "\x50"
-    #define ARROW_LEFT "\x4B"
-    #define ARROW_RIGHT "\x4D"
-    #define HOME_KEY "\x47"
-    #define END_KEY "\x4F"
-    #define PAGEUP_KEY "\x49"
-    #define PAGEDOWN_KEY "\x51"
-    #define F1_KEY "\x00\x3B"
-    #define F2_KEY "\x00\x3C"
-    #define F3_KEY "\x00\x3D"
-    #define F4_KEY "\x00\x3E"
-    #define F5_KEY "\x00\x3F"
-    #define F6_KEY "\x00\x40"
-    #define F7_KEY "\x00\x41"
-    #define F8_KEY "\x00\x42"
-    #define F9_KEY "\x00\x43"
-    #define F10_KEY "\x00\x44"
-    #define F11_KEY "\x00\x85"
-    #define F12_KEY "\x00\x86"
-#else
-    #define ARROW_UP "\x1b[A"
-    #define ARROW_DOWN "\x1b[B"
-    #define ARROW_LEFT "\x1b[D"
-    #define ARROW_RIGHT "\x1b[C"
-    #define HOME_KEY "\x1b[H"
-    #define END_KEY "\x1b[F"
-    #define PAGEUP_KEY "\x1b[5~"
-    #define PAGEDOWN_KEY "\x1b[6~"
-    #define F1_KEY "\x1b[11~"
-    #define F2_KEY "\x1b[12~"
-    #define F3_KEY "\x1b[13~"
-    #define F4_KEY "\x1b[14~"
-    #define F5_KEY "\x1b[15~"
-    #define F6_KEY "\x1b[17~"
-    #define F7_KEY "\x1b[18~"
-    #define F8_KEY "\x1b[19~"
-    #define F9_KEY "\x1b[20~"
-    #define F10_KEY "\x1b[21~"
-    #define F11_KEY "\x1b[23~"
-    #define F12_KEY "\x1b[24~"
-#endif
 // ***********************************
 
 namespace qonsole {
@@ -158,577 +301,5937 @@ namespace qonsole {
         NONE
     };
 
+    enum q_render_backend {
+        SOFTWARE,  // QPainter on the widget
+        OPENGL     // instanced draw over a glyph atlas, needs QONSOLE_OPENGL
+    };
+
+    enum q_frame_pacing {
+        THROUGHPUT,  // at most one frame per display refresh
+        LATENCY      // like THROUGHPUT, but keystroke echo is presented right away
+    };
+
+    enum q_cursor_keys {
+        CURSOR_KEYS_AUTO,        // follow the program's DECCKM
+        CURSOR_KEYS_NORMAL,      // always `ESC [ A`
+        CURSOR_KEYS_APPLICATION  // always `ESC O A`
+    };
+
+    enum q_resize_mode {
+        RESIZE_IMMEDIATE,  // the terminal is resized on each call
+        RESIZE_CLIP,       // debounced, the current grid is shown clipped meanwhile
+        RESIZE_STRETCH     // debounced, the last frame is scaled to the new grid meanwhile
+    };
+
+    // one slot per screen cell, filled by a single pass over the screen
+    struct q_dump_grid {
+        unsigned int width = 0;
+        unsigned int height = 0;
+
+        // first codepoint of each cell, 0 for the continuation of a wide character
+        std::vector<char32_t> cells;
+
+        // combining codepoints following a cell, ordered by cell index
+        std::vector<std::pair<size_t, std::u32string>> extra;
+    };
+
     // ********************************
 
     namespace utils {
-        // convert a Qt Key to ascii
-        inline QByteArray qey2a(QKeyEvent*event) {
-            if (event->modifiers() == Qt::ControlModifier) {
-                if      (event->key() == Qt::Key_C) return "\x03";
-                else if (event->key() == Qt::Key_B) return "\x02";
-                else if (event->key() == Qt::Key_N) return "\x0E";
-                else if (event->key() == Qt::Key_P) return "\x10";
-                else if (event->key() == Qt::Key_O) return "\x0F";
-                else if (event->key() == Qt::Key_F) return "\x06";
-                else if (event->key() == Qt::Key_D) return "\x04";
-                else                                return QByteArray();
+        inline void append_utf8(QByteArray &out, char32_t c) {
+            if (c < 0x80) {
+                out.append(static_cast<char>(c));
+            }
+            else if (c < 0x800) {
+                out.append(static_cast<char>(0xC0 | (c >> 6)));
+                out.append(static_cast<char>(0x80 | (c & 0x3F)));
+            }
+            else if (c < 0x10000) {
+                out.append(static_cast<char>(0xE0 | (c >> 12)));
+                out.append(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+                out.append(static_cast<char>(0x80 | (c & 0x3F)));
             }
             else {
-                if (event->key() == Qt::Key_Return || event->key() == Qt::Key_Enter) return "\n";
-                else if (event->key() == Qt::Key_Tab)       return "\t";
-                else if (event->key() == Qt::Key_Backspace) return "\x08";
-                else if (event->key() == Qt::Key_Home)      return HOME_KEY;
-                else if (event->key() == Qt::Key_End)       return END_KEY;
-                else if (event->key() == Qt::Key_Left)      return ARROW_LEFT;
-                else if (event->key() == Qt::Key_Up)        return ARROW_UP;
-                else if (event->key() == Qt::Key_Right)     return ARROW_RIGHT;
-                else if (event->key() == Qt::Key_Down)      return ARROW_DOWN;
-                else if (event->key() == Qt::Key_PageUp)    return PAGEUP_KEY;
-                else if (event->key() == Qt::Key_PageDown)  return PAGEDOWN_KEY;
-                else if (event->key() == Qt::Key_F1)        return F1_KEY;
-                else if (event->key() == Qt::Key_F2)        return F2_KEY;
-                else if (event->key() == Qt::Key_F3)        return F3_KEY;
-                else if (event->key() == Qt::Key_F4)        return F4_KEY;
-                else if (event->key() == Qt::Key_F5)        return F5_KEY;
-                else if (event->key() == Qt::Key_F6)        return F6_KEY;
-                else if (event->key() == Qt::Key_F7)        return F7_KEY;
-                else if (event->key() == Qt::Key_F8)        return F8_KEY;
-                else if (event->key() == Qt::Key_F9)        return F9_KEY;
-                else if (event->key() == Qt::Key_F10)       return F10_KEY;
-                else if (event->key() == Qt::Key_F11)       return F11_KEY;
-                else if (event->key() == Qt::Key_F12)       return F12_KEY;
-                else return event->text().toUtf8();
+                out.append(static_cast<char>(0xF0 | (c >> 18)));
+                out.append(static_cast<char>(0x80 | ((c >> 12) & 0x3F)));
+                out.append(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+                out.append(static_cast<char>(0x80 | (c & 0x3F)));
             }
         }
-    }  // end of utils
 
-    // threaded reader
-    class QonsoleReader : public QThread {
-        Q_OBJECT
+        inline char fold_ascii(char c) {
+            return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+        }
 
-        std::atomic<bool> __running = false;
+        // filter bit of the ASCII folded trigram at p
+        inline uint32_t gram_bit(const char *p) {
+            uint32_t g = static_cast<uchar>(fold_ascii(p[0]))
+                       | static_cast<uchar>(fold_ascii(p[1])) << 8
+                       | static_cast<uchar>(fold_ascii(p[2])) << 16;
 
-        public:
+            return ((g * 2654435761u) >> 16) & (HISTORY_GRAM_BITS - 1);
+        }
 
-            #if defined(__linux__) || defined(__APPLE__)
-            const int file_descriptor = 0;
+        // LEB128 varint, as used by session recordings
+        inline void put_varint(QByteArray &out, quint64 v) {
+            while (v >= 0x80) {
+                out.append(static_cast<char>(v | 0x80));
+                v >>= 7;
+            }
 
-            #elif defined(_WIN32)
-            const union {
-                HANDLE handle = INVALID_HANDLE_VALUE;     // for file handles
-                SOCKET socket = INVALID_SOCKET;      // for socket handles
-            };
-            bool is_socket = false; // flag to identify handle type
-            #endif
+            out.append(static_cast<char>(v));
+        }
 
-            // unix-like constructor
-            #if defined(__linux__) || defined(__APPLE__)
-            QonsoleReader(int fd) : file_descriptor(fd) {}
+        // false when the varint runs past `end`
+        inline bool get_varint(const uchar *&p, const uchar *end, quint64 &v) {
+            v = 0;
 
-            #elif defined(_WIN32)
-            // file handle constructor
-            QonsoleReader(HANDLE h) {
-                this->handle = h;
-                this->is_socket = false;
-            }
-            // socket handle constructor
-            QonsoleReader(SOCKET s) {
-                this->socket = s;
-                this->is_socket = true;
-            }
-            #endif
+            for (int shift = 0; p < end && shift < 64; shift += 7) {
+                uchar b = *p++;
+                v |= static_cast<quint64>(b & 0x7F) << shift;
 
-            // general
-            bool is_running() {
-                return __running.load();
+                if (!(b & 0x80))
+                    return true;
             }
 
-        protected:
-            // each time try to read 32 bytes
-            void run() override {
-                if (is_running()) {
-                    qDebug() << "reader already running!";
-                    return;
-                }
+            return false;
+        }
 
-                qDebug() << "reader running ...";
+        inline QByteArray to_utf8(const std::u32string &text) {
+            QByteArray out;
+            out.reserve(static_cast<int>(text.size()));
 
-                #if defined(__linux__) || defined(__APPLE__)
-                qDebug() << "reading ...";
+            for (char32_t c : text)
+                append_utf8(out, c);
 
-                // read and emit
-                while (true) {
-                    char buffer[BUFFER_SIZE];
+            return out;
+        }
 
-                    ssize_t bytes_read = read(this->file_descriptor, buffer, BUFFER_SIZE);
 
-                    if (bytes_read > 0) {
-                        QByteArray data(buffer, bytes_read);
+        // one key's output in the keymap, the longest is `ESC [ 2 4 ; 8 ~`
+        struct q_key_sequence {
+            char bytes[7] = {};
+            uint8_t len = 0;
+        };
+
+        // keymap slots: printable ASCII keys, then Qt's special keys from
+        // Key_Escape to Key_F12. modifiers index a Shift/Alt/Ctrl bit set,
+        // the xterm modifier parameter minus one
+        enum {
+            KEYMAP_ASCII = 0x60,
+            KEYMAP_SPECIAL = Qt::Key_F12 - Qt::Key_Escape + 1,
+            KEYMAP_SLOTS = KEYMAP_ASCII + KEYMAP_SPECIAL,
+            KEYMAP_SHIFT = 1,
+            KEYMAP_ALT = 2,
+            KEYMAP_CTRL = 4,
+            KEYMAP_MODIFIERS = 8
+        };
+
+        struct q_keymap {
+            // [application cursor keys][slot][modifiers], empty entries fall
+            // back to the event's text
+            q_key_sequence keys[2][KEYMAP_SLOTS][KEYMAP_MODIFIERS];
+        };
+
+        constexpr int key_slot(int key) {
+            if (key >= 0x20 && key < 0x20 + KEYMAP_ASCII)
+                return key - 0x20;
+
+            if (key >= Qt::Key_Escape && key <= Qt::Key_F12)
+                return KEYMAP_ASCII + key - Qt::Key_Escape;
+
+            return -1;
+        }
 
-                        emit data_ready(data);
+        // Qt reports the Control key as Meta on macOS, Command takes its place
+        inline int modifier_index(Qt::KeyboardModifiers mods) {
+            #ifdef __APPLE__
+            const Qt::KeyboardModifier ctrl = Qt::MetaModifier;
+            #else
+            const Qt::KeyboardModifier ctrl = Qt::ControlModifier;
+            #endif
 
-                    } else if (bytes_read == 0) {
-                        qDebug() << "End of file reached.";
-                        break;
-                    } else {
-                        qDebug() << "Error reading from file descriptor.";
-                        break;
-                    }
-                }
+            return (mods.testFlag(Qt::ShiftModifier) ? KEYMAP_SHIFT : 0)
+                 | (mods.testFlag(Qt::AltModifier) ? KEYMAP_ALT : 0)
+                 | (mods.testFlag(ctrl) ? KEYMAP_CTRL : 0);
+        }
 
-                qDebug() << "done reading.";
-                #elif defined(_WIN32)
-                // check if using socket or file handle
-                if (is_socket) {
-                    qDebug() << "reading from socket:" << socket;
-                    
-                    while (__running) {
-                        char buffer[BUFFER_SIZE];
-                        int bytes_read = recv(socket, buffer, BUFFER_SIZE, 0);
-                        
-                        if (bytes_read > 0) {
-                            QByteArray data(buffer, bytes_read);
-                            emit data_ready(data);
-                        } else if (bytes_read == 0) {
-                            qDebug() << "Socket closed.";
-                            break;
-                        } else {
-                            int error = WSAGetLastError();
-                            if (error == WSAEWOULDBLOCK) {
-                                QThread::msleep(10);
-                                continue;
-                            }
-                            qDebug() << "Error reading from socket:" << error;
-                            break;
-                        }
-                    }
-                } else {
-                    qDebug() << "reading from handle:" << handle;
-                    
-                    while (__running) {
-                        char buffer[BUFFER_SIZE];
-                        DWORD bytes_read = 0;
-                        
-                        if (ReadFile(handle, buffer, BUFFER_SIZE, &bytes_read, nullptr)) {
-                            if (bytes_read > 0) {
-                                QByteArray data(buffer, static_cast<int>(bytes_read));
-                                emit data_ready(data);
-                            }
-                        } else {
-                            DWORD error = GetLastError();
-                            if (error == ERROR_BROKEN_PIPE || error == ERROR_HANDLE_EOF) {
-                                qDebug() << "Pipe closed.";
-                                break;
-                            }
-                            qDebug() << "Error reading from handle:" << error;
-                            break;
-                        }
-                    }
-                }
-                
-                qDebug() << "done reading.";
-                #endif
-                
-                __running = false;
+        constexpr void key_append(q_key_sequence &seq, char c) {
+            seq.bytes[seq.len++] = c;
+        }
+
+        constexpr void key_append_number(q_key_sequence &seq, int n) {
+            if (n >= 10)
+                key_append(seq, '0' + n / 10);
+            key_append(seq, '0' + n % 10);
+        }
+
+        // `ESC [ code ; m final`, the code omitted when 1 and unmodified
+        constexpr q_key_sequence key_csi(int code, int mods, char final) {
+            q_key_sequence seq;
+            key_append(seq, '\x1b');
+            key_append(seq, '[');
+
+            if (code != 1 || mods)
+                key_append_number(seq, code);
+
+            if (mods) {
+                key_append(seq, ';');
+                key_append_number(seq, mods + 1);
             }
 
-            
-        signals:
-            // listen and when data ready emit this signal
-            void data_ready(QByteArray data);
-    };
+            key_append(seq, final);
+            return seq;
+        }
 
-    class QonsoleWidget : public QWidget {
-        Q_OBJECT
+        constexpr q_key_sequence key_ss3(char final) {
+            q_key_sequence seq;
+            key_append(seq, '\x1b');
+            key_append(seq, 'O');
+            key_append(seq, final);
+            return seq;
+        }
 
-        signals:
-            void destructed(QonsoleReader*);
-            void closed(QonsoleReader*);
+        // `c`, prefixed with ESC when Alt is held
+        constexpr q_key_sequence key_char(char c, int mods) {
+            q_key_sequence seq;
+            if (mods & KEYMAP_ALT)
+                key_append(seq, '\x1b');
+            key_append(seq, c);
+            return seq;
+        }
 
-        protected:
-            QonsoleReader *reader = nullptr;
+        // control code Ctrl turns an ASCII key into, -1 for none
+        constexpr int key_control(int key) {
+            if (key >= 'A' && key <= 'Z')
+                return key & 0x1F;
+
+            switch (key) {
+                case ' ': case '@': case '2': return 0x00;
+                case '[': case '3':           return 0x1B;
+                case '\\': case '4':          return 0x1C;
+                case ']': case '5':           return 0x1D;
+                case '^': case '6':           return 0x1E;
+                case '_': case '/': case '7': return 0x1F;
+                case '?': case '8':           return 0x7F;
+                default:                      return -1;
+            }
+        }
 
-            QFont m_font;
-            int m_char_width;
-            int m_char_height;
-            int m_cols = 80;
-            int m_lines = 24;
-            bool m_use_bold = false;
-            bool m_is_selecting = false;  // inner state
-            bool m_draw_empty_cells = false;
-            bool __m_requesting_dump = false;
-            int m_scroll_offset = 0;  // Current scroll position (0 = bottom/latest output)
-            int m_max_scrollback = 1000;  // Maximum lines to keep in scrollback buffer
+        // xterm's encoding of every key and modifier combination
+        constexpr q_keymap build_keymap() {
+            q_keymap map;
 
-            QColor m_default_fg;
-            QColor m_default_bg;
-            QColor m_selection_bg;
-            QColor m_palette[16];
+            struct q_cursor_key { int key; char final; };
+            const q_cursor_key cursor_keys[] = {
+                {Qt::Key_Up, 'A'}, {Qt::Key_Down, 'B'}, {Qt::Key_Right, 'C'}, {Qt::Key_Left, 'D'},
+                {Qt::Key_Home, 'H'}, {Qt::Key_End, 'F'},
+            };
 
-            struct q_draw_context {
-                QPainter* painter;
-                QonsoleWidget* widget;
+            struct q_tilde_key { int key; int code; };
+            const q_tilde_key tilde_keys[] = {
+                {Qt::Key_Insert, 2}, {Qt::Key_Delete, 3}, {Qt::Key_PageUp, 5}, {Qt::Key_PageDown, 6},
+                {Qt::Key_F5, 15}, {Qt::Key_F6, 17}, {Qt::Key_F7, 18}, {Qt::Key_F8, 19},
+                {Qt::Key_F9, 20}, {Qt::Key_F10, 21}, {Qt::Key_F11, 23}, {Qt::Key_F12, 24},
             };
 
-            q_cursor_style m_qcstyle = q_cursor_style::BLOCK;
-            q_cursor_pos m_cursor_pos {0, 0};
-            q_selection m_selection {0, 2, 0, 9, true};
+            const q_cursor_key function_keys[] = {
+                {Qt::Key_F1, 'P'}, {Qt::Key_F2, 'Q'}, {Qt::Key_F3, 'R'}, {Qt::Key_F4, 'S'},
+            };
 
-            // tsm
-            struct tsm_screen* m_screen;
-            struct tsm_vte* m_vte;
+            for (int app = 0; app < 2; ++app) {
+                for (int mods = 0; mods < KEYMAP_MODIFIERS; ++mods) {
+                    auto &keys = map.keys[app];
 
-            void closeEvent(QCloseEvent *event) {
-                emit closed(reader);
-            }
+                    for (const q_cursor_key &k : cursor_keys)
+                        keys[key_slot(k.key)][mods] = (app && !mods) ? key_ss3(k.final) : key_csi(1, mods, k.final);
 
-            void paintEvent(QPaintEvent *event) override {
-                QPainter painter(this);
+                    for (const q_tilde_key &k : tilde_keys)
+                        keys[key_slot(k.key)][mods] = key_csi(k.code, mods, '~');
 
-                draw_screen(painter);
-                
-                if (!m_screen)
-                    return;
-                
-                // only draw cursor if we're at the bottom (not scrolled back)
-                if (m_scroll_offset == 0) {
-                    draw_cursor(painter);
-                }
-                
-                painter.setFont(m_font);
-                
-                q_draw_context ctx;
-                ctx.painter = &painter;
-                ctx.widget = this;
-                
-                tsm_screen_draw(m_screen, draw_callback, &ctx);
-            }
-            
-            void keyPressEvent(QKeyEvent *event) override {
-                // handle scrolling keys first (don't send to terminal)
-                if (event->key() == Qt::Key_PageUp && event->modifiers() == Qt::ShiftModifier) {
-                    scroll_up(m_lines);  // scroll up one page
-                    return;
-                }
-                if (event->key() == Qt::Key_PageDown && event->modifiers() == Qt::ShiftModifier) {
-                    scroll_down(m_lines);  // scroll down one page
-                    return;
-                }
-                if (event->key() == Qt::Key_Home && event->modifiers() == Qt::ShiftModifier) {
-                    scroll_to_top();
-                    return;
-                }
-                if (event->key() == Qt::Key_End && event->modifiers() == Qt::ShiftModifier) {
-                    scroll_to_bottom();
-                    return;
-                }
-                
-                // any other key press should jump to bottom (follow output)
-                if (m_scroll_offset > 0) {
-                    scroll_to_bottom();
-                }
+                    for (const q_cursor_key &k : function_keys)
+                        keys[key_slot(k.key)][mods] = mods ? key_csi(1, mods, k.final) : key_ss3(k.final);
 
-                reset_selection();
+                    keys[key_slot(Qt::Key_Escape)][mods] = key_char('\x1b', mods);
+                    keys[key_slot(Qt::Key_Return)][mods] = key_char('\r', mods);
+                    keys[key_slot(Qt::Key_Enter)][mods] = key_char('\r', mods);
+                    keys[key_slot(Qt::Key_Backspace)][mods] = key_char((mods & KEYMAP_CTRL) ? '\x08' : '\x7F', mods);
 
-                // translate QKeyEvent to terminal input sequences
-                QByteArray sequence = qonsole::utils::qey2a(event);
+                    // Shift+Tab arrives as Backtab
+                    q_key_sequence back_tab = key_csi(1, 0, 'Z');
+                    keys[key_slot(Qt::Key_Tab)][mods] = (mods & KEYMAP_SHIFT) ? back_tab : key_char('\t', mods);
+                    keys[key_slot(Qt::Key_Backtab)][mods] = back_tab;
 
-                if (!sequence.isEmpty()) {
-                    write_to_source(sequence);
-                    update_cursor_pos();
+                    // printable keys send their text unless Ctrl makes a control code of them
+                    if (mods & KEYMAP_CTRL) {
+                        for (int key = 0x20; key < 0x20 + KEYMAP_ASCII; ++key) {
+                            int code = key_control(key);
+                            if (code >= 0)
+                                keys[key_slot(key)][mods] = key_char(code, mods);
+                        }
+                    }
                 }
             }
 
-            void mousePressEvent(QMouseEvent *event) override {
-                reset_selection();
+            return map;
+        }
 
-                m_selection.active = true;
-                px2pos(event->pos(), m_selection.start_column, m_selection.start_line);
+        inline constexpr q_keymap keymap = build_keymap();
+
+        // bytes a key press sends, looked up in the keymap. `application_cursor`
+        // selects the DECCKM encoding of the unmodified cursor keys
+        inline QByteArray key_sequence(const QKeyEvent *event, bool application_cursor) {
+            int slot = key_slot(event->key());
+            int mods = modifier_index(event->modifiers());
 
+            if (slot >= 0) {
+                const q_key_sequence &seq = keymap.keys[application_cursor][slot][mods];
+                if (seq.len > 0)
+                    return QByteArray(seq.bytes, seq.len);
             }
 
-            void mouseReleaseEvent(QMouseEvent *event) override {
-                m_selection.active = false;
-                update();
-                // qDebug() << this->selected_text();
+            QByteArray text = event->text().toUtf8();
+
+            if ((mods & KEYMAP_ALT) && !text.isEmpty())
+                text.prepend('\x1b');
+
+            return text;
+        }
+    }  // end of utils
+
+    // run of scrollback cells sharing the same attributes
+    struct q_history_run {
+        uint16_t cells;
+        uint8_t width;
+        struct tsm_screen_attr attr;
+    };
+
+    // a decoded scrollback line: the codepoints of its cells, a base character
+    // followed by its combining marks, and the (cell, codepoints) of the cells
+    // holding more than one. trailing blank cells trimmed
+    struct q_history_line {
+        std::u32string cells;
+        std::vector<std::pair<uint16_t, uint8_t>> clusters;
+        std::vector<q_history_run> runs;
+
+        // call fn(ch, len, run) for each cell in column order
+        template<typename F>
+        void for_each_cell(F fn) const {
+            size_t at = 0;
+            size_t cell = 0;
+            size_t cluster = 0;
+
+            for (const q_history_run &run : runs) {
+                for (uint16_t i = 0; i < run.cells; ++i, ++cell) {
+                    size_t len = 1;
+
+                    if (cluster < clusters.size() && clusters[cluster].first == cell)
+                        len = clusters[cluster++].second;
+
+                    if (at + len > cells.size())
+                        return;
+
+                    fn(cells.data() + at, len, run);
+                    at += len;
+                }
             }
+        }
+    };
 
-            void mouseMoveEvent(QMouseEvent *event) override {
-                if (m_selection.active) {
-                    m_is_selecting = true;
-                    px2pos(event->pos(), m_selection.end_column, m_selection.end_line);
+    // scrollback kept outside libtsm under a byte budget. lines are encoded as
+    // attribute runs, the cells holding combining marks, then UTF-8 text and grouped in blocks of HISTORY_BLOCK_LINES,
+    // full blocks are zlib compressed and decoded again on access. once over
+    // budget the oldest blocks are spilled to a mapped file if enabled, dropped
+    // otherwise. every block but the last holds exactly HISTORY_BLOCK_LINES lines,
+    // so finding a line is a division whatever the history length
+    class QonsoleScrollback {
+        Q_DISABLE_COPY(QonsoleScrollback)
+
+        struct q_block {
+            QByteArray data;                 // resident bytes, empty once spilled
+            const uchar *spilled = nullptr;  // bytes in the spill file mapping
+            uint32_t size = 0;               // spilled bytes
+            uint32_t segment = 0;            // spill segment holding them
+            uint32_t lines = 0;
+            bool compressed = false;
+
+            // trigrams present in the block's text, see may_contain()
+            std::vector<uint64_t> grams = std::vector<uint64_t>(HISTORY_GRAM_BITS / 64, 0);
+        };
+
+        // decoded copy of a block, keyed on the absolute index of its first line
+        struct q_decoded {
+            quint64 first;
+            std::vector<q_history_line> lines;
+        };
+
+        std::deque<q_block> m_blocks;
+        std::deque<q_decoded> m_decoded;  // most recently used first
+
+        size_t m_budget;
+        bool m_compress;
+        size_t m_bytes = 0;
+        size_t m_lines = 0;
+        quint64 m_dropped = 0;
+
+        q_history_line m_pending;
+        size_t m_pending_cells = 0;
+
+        // a mapped HISTORY_SPILL_SEGMENT of the spill file
+        struct q_segment {
+            uchar *map;
+            size_t blocks = 0;  // spilled blocks still kept in it
+        };
+
+        // spill file, created on the first spill and mapped segment by segment.
+        // blocks are dropped oldest first, so segments empty in the order they
+        // were filled and are reused as a ring before the file grows
+        bool m_spill_enabled = false;
+        QString m_spill_dir;
+        size_t m_disk_budget = 0;
+        size_t m_disk_bytes = 0;
+        QTemporaryFile *m_spill = nullptr;
+        std::vector<q_segment> m_segments;
+        std::deque<size_t> m_free_segments;
+        size_t m_segment = 0;  // segment being filled
+        size_t m_segment_used = 0;
+        size_t m_resident = 0;  // index of the first block not spilled
+
+        static QByteArray bytes(const q_block &b) {
+            if (b.spilled)
+                return QByteArray::fromRawData(reinterpret_cast<const char*>(b.spilled), b.size);
+
+            return b.data;
+        }
 
-                    update();
+        // move a sealed block into the spill file
+        bool spill(q_block &b) {
+            size_t size = b.data.size();
+
+            if (size > HISTORY_SPILL_SEGMENT)
+                return false;
+
+            if (!m_spill) {
+                m_spill = m_spill_dir.isEmpty()
+                    ? new QTemporaryFile()
+                    : new QTemporaryFile(m_spill_dir + "/qonsole-XXXXXX.history");
+
+                if (!m_spill->open()) {
+                    qWarning() << "Failed to create scrollback spill file:" << m_spill->errorString();
+                    close_spill();
+                    m_spill_enabled = false;
+                    return false;
                 }
             }
-            
-            void wheelEvent(QWheelEvent *event) override {                
-                if (!m_screen)
-                    return;
-                
-                // get the scroll delta from the wheel event
-                // positive delta = wheel up (scroll backward/up in history)
-                // negative delta = wheel down (scroll forward/down toward latest)
-                int delta = event->angleDelta().y();
-                
-                if (delta > 0) {
-                    // scroll up (backward in history)
-                    tsm_screen_sb_up(m_screen, 1);
-                    m_scroll_offset += delta;
 
-                } 
-                else if (delta < 0) {
-                    // scroll down (forward toward latest)
-                    if (m_scroll_offset > 0) {
-                        tsm_screen_sb_down(m_screen, delta);
-                        m_scroll_offset -= delta;
+            if (m_segments.empty() || m_segment_used + size > HISTORY_SPILL_SEGMENT) {
+                // the segment left behind is free once its blocks are dropped
+                if (!m_segments.empty() && m_segments[m_segment].blocks == 0)
+                    m_free_segments.push_back(m_segment);
+
+                if (!m_free_segments.empty()) {
+                    m_segment = m_free_segments.front();
+                    m_free_segments.pop_front();
+                }
+                else {
+                    qint64 offset = static_cast<qint64>(m_segments.size()) * HISTORY_SPILL_SEGMENT;
+                    uchar *map = nullptr;
+
+                    if (m_spill->resize(offset + HISTORY_SPILL_SEGMENT))
+                        map = m_spill->map(offset, HISTORY_SPILL_SEGMENT);
+
+                    if (!map) {
+                        qWarning() << "Failed to grow scrollback spill file:" << m_spill->errorString();
+                        return false;
                     }
+
+                    m_segment = m_segments.size();
+                    m_segments.push_back({map});
                 }
-                
-                // Repaint to show the new viewport
-                update();
+
+                m_segment_used = 0;
             }
 
-            void update_cursor_pos() {
-                m_cursor_pos.x = tsm_screen_get_cursor_x(m_screen);
-                m_cursor_pos.y = tsm_screen_get_cursor_y(m_screen);
-                update();
+            q_segment &segment = m_segments[m_segment];
+            uchar *dst = segment.map + m_segment_used;
+            memcpy(dst, b.data.constData(), size);
+            m_segment_used += size;
+            segment.blocks++;
+
+            b.spilled = dst;
+            b.size = static_cast<uint32_t>(size);
+            b.segment = static_cast<uint32_t>(m_segment);
+            b.data = QByteArray();
+
+            m_bytes -= size;
+            m_disk_bytes += size;
+            return true;
+        }
+
+        void close_spill() {
+            if (m_spill) {
+                for (const q_segment &segment : m_segments)
+                    m_spill->unmap(segment.map);
+
+                delete m_spill;
+                m_spill = nullptr;
             }
 
-            void update_metrics() {
-                m_font.setStyleHint(QFont::TypeWriter);
-                m_font.setFixedPitch(true);
-                
-                QFontMetrics fm(m_font);
-                m_char_width = fm.horizontalAdvance('M');
-                m_char_height = fm.height();
+            m_segments.clear();
+            m_free_segments.clear();
+            m_segment = 0;
+            m_segment_used = 0;
+            m_disk_bytes = 0;
+        }
+
+        void drop_front() {
+            const q_block &b = m_blocks.front();
+
+            if (b.spilled) {
+                m_disk_bytes -= b.size;
+                m_resident--;
+
+                // the segment being filled is freed when it is left
+                if (--m_segments[b.segment].blocks == 0 && b.segment != m_segment)
+                    m_free_segments.push_back(b.segment);
+            }
+            else {
+                m_bytes -= b.data.size();
             }
 
-            void draw_cursor(QPainter &painter) {
-                if (m_qcstyle == q_cursor_style::NONE) {
-                    return;
-                }
+            m_lines -= b.lines;
+            m_dropped += b.lines;
+            m_blocks.pop_front();
+        }
 
-                // If cursor style is IBEAM or UNDERLINE and widget does not have focus, do not draw cursor
-                if ((
-                        m_qcstyle == q_cursor_style::IBEAM || 
-                        m_qcstyle == q_cursor_style::UNDERLINE
-                    ) && !hasFocus()) {
-                    return;
-                }
+        static void put_u16(QByteArray &out, uint16_t v) {
+            out.append(static_cast<char>(v & 0xFF));
+            out.append(static_cast<char>(v >> 8));
+        }
 
-                // otherwise draw full cursor, if has focus, if not draw only cursor border
-                int x = m_cursor_pos.x * m_char_width;
-                int y = m_cursor_pos.y * m_char_height;
+        static void put_u32(QByteArray &out, uint32_t v) {
+            put_u16(out, v & 0xFFFF);
+            put_u16(out, v >> 16);
+        }
 
-                // if block cursor
-                if (m_qcstyle == q_cursor_style::BLOCK) {
-                    painter.fillRect(x, y, m_char_width, m_char_height, m_default_fg);
-                }
-                // if underline cursor
-                else if (m_qcstyle == q_cursor_style::UNDERLINE) {
-                    painter.fillRect(x, y + m_char_height - 2, m_char_width, 2, m_default_fg);
+        static uint16_t get_u16(const uchar *p) {
+            return p[0] | (p[1] << 8);
+        }
+
+        static uint32_t get_u32(const uchar *p) {
+            return get_u16(p) | (static_cast<uint32_t>(get_u16(p + 2)) << 16);
+        }
+
+        static bool same_attr(const tsm_screen_attr &a, const tsm_screen_attr &b) {
+            return a.fccode == b.fccode && a.bccode == b.bccode
+                && a.fr == b.fr && a.fg == b.fg && a.fb == b.fb
+                && a.br == b.br && a.bg == b.bg && a.bb == b.bb
+                && a.bold == b.bold && a.underline == b.underline
+                && a.inverse == b.inverse && a.protect == b.protect && a.blink == b.blink;
+        }
+
+        // a blank cell with this attribute renders as the default background
+        static bool blank_attr(const tsm_screen_attr &a) {
+            return !a.inverse && a.bccode >= 16;
+        }
+
+        // a line is a header of its run count, text length and cluster count, 12
+        // bytes per run, 3 per cluster and the text
+        void encode(QByteArray &out, const q_history_line &line, const QByteArray &text) {
+            put_u16(out, static_cast<uint16_t>(line.runs.size()));
+            put_u32(out, static_cast<uint32_t>(text.size()));
+            put_u16(out, static_cast<uint16_t>(line.clusters.size()));
+
+            for (const q_history_run &run : line.runs) {
+                put_u16(out, run.cells);
+                out.append(static_cast<char>(run.width));
+                out.append(static_cast<char>(run.attr.fccode));
+                out.append(static_cast<char>(run.attr.bccode));
+                out.append(static_cast<char>(run.attr.fr));
+                out.append(static_cast<char>(run.attr.fg));
+                out.append(static_cast<char>(run.attr.fb));
+                out.append(static_cast<char>(run.attr.br));
+                out.append(static_cast<char>(run.attr.bg));
+                out.append(static_cast<char>(run.attr.bb));
+                out.append(static_cast<char>(
+                    run.attr.bold | run.attr.underline << 1 | run.attr.inverse << 2
+                    | run.attr.protect << 3 | run.attr.blink << 4
+                ));
+            }
+
+            for (const std::pair<uint16_t, uint8_t> &cluster : line.clusters) {
+                put_u16(out, cluster.first);
+                out.append(static_cast<char>(cluster.second));
+            }
+
+            out.append(text);
+        }
+
+        static void decode(const QByteArray &data, std::vector<q_history_line> &lines) {
+            const uchar *p = reinterpret_cast<const uchar*>(data.constData());
+            const uchar *end = p + data.size();
+
+            while (p + 8 <= end) {
+                q_history_line line;
+                uint16_t runs = get_u16(p);
+                uint32_t text = get_u32(p + 2);
+                uint16_t clusters = get_u16(p + 6);
+                p += 8;
+
+                for (uint16_t i = 0; i < runs && p + 12 <= end; ++i, p += 12) {
+                    q_history_run run {};
+                    run.cells = get_u16(p);
+                    run.width = p[2];
+                    run.attr.fccode = static_cast<int8_t>(p[3]);
+                    run.attr.bccode = static_cast<int8_t>(p[4]);
+                    run.attr.fr = p[5];
+                    run.attr.fg = p[6];
+                    run.attr.fb = p[7];
+                    run.attr.br = p[8];
+                    run.attr.bg = p[9];
+                    run.attr.bb = p[10];
+                    run.attr.bold = p[11] & 1;
+                    run.attr.underline = (p[11] >> 1) & 1;
+                    run.attr.inverse = (p[11] >> 2) & 1;
+                    run.attr.protect = (p[11] >> 3) & 1;
+                    run.attr.blink = (p[11] >> 4) & 1;
+                    line.runs.push_back(run);
                 }
-                // if IBEAM cursor
-                else if (m_qcstyle == q_cursor_style::IBEAM) {
-                    painter.fillRect(x + (m_char_width / 2) - 1, y, 2, m_char_height, m_default_fg);
+
+                for (uint16_t i = 0; i < clusters && p + 3 <= end; ++i, p += 3)
+                    line.clusters.emplace_back(get_u16(p), p[2]);
+
+                if (p + text > end)
+                    break;
+
+                line.cells = QString::fromUtf8(reinterpret_cast<const char*>(p), text).toStdU32String();
+                p += text;
+
+                lines.push_back(std::move(line));
+            }
+        }
+
+        const std::vector<q_history_line>& decoded(size_t block) {
+            const q_block &b = m_blocks[block];
+            quint64 first = m_dropped + static_cast<quint64>(block) * HISTORY_BLOCK_LINES;
+
+            for (auto it = m_decoded.begin(); it != m_decoded.end(); ++it) {
+                // the open block keeps growing, a shorter copy is stale
+                if (it->first == first && it->lines.size() == b.lines) {
+                    if (it != m_decoded.begin()) {
+                        q_decoded hit = std::move(*it);
+                        m_decoded.erase(it);
+                        m_decoded.push_front(std::move(hit));
+                    }
+                    return m_decoded.front().lines;
                 }
             }
 
-            void draw_screen(QPainter &painter) {
-                painter.fillRect(rect(), m_default_bg);
+            q_decoded entry;
+            entry.first = first;
+            QByteArray data = bytes(b);
+            decode(b.compressed ? qUncompress(data) : data, entry.lines);
+
+            m_decoded.push_front(std::move(entry));
+            while (m_decoded.size() > HISTORY_DECODED_BLOCKS)
+                m_decoded.pop_back();
+
+            return m_decoded.front().lines;
+        }
+
+        void enforce_budget() {
+            bool spilled = m_spill_enabled;
+
+            // the open block always stays in memory
+            while (spilled && m_bytes > m_budget && m_resident + 1 < m_blocks.size()) {
+                spilled = spill(m_blocks[m_resident]);
+
+                if (spilled)
+                    m_resident++;
             }
 
-            bool is_selected(uint col, uint line) {
-                if (!m_is_selecting) return false;
+            while (m_blocks.size() > 1
+                   && ((!spilled && m_bytes > m_budget)
+                       || (m_disk_budget > 0 && m_disk_bytes > m_disk_budget))) {
+                drop_front();
+            }
+        }
 
-                int sl = m_selection.start_line;
-                int sc = m_selection.start_column;
-                int el = m_selection.end_line;
-                int ec = m_selection.end_column;
+        public:
+            QonsoleScrollback(size_t budget, bool compress = true)
+                : m_budget(budget), m_compress(compress) {}
 
-                // Normalize selection (ensure (sl,sc) <= (el,ec))
-                if (sl > el || (sl == el && sc > ec)) {
-                    std::swap(sl, el);
-                    std::swap(sc, ec);
+            ~QonsoleScrollback() {
+                m_blocks.clear();
+                close_spill();
+            }
+
+            // spill blocks over the memory budget to a file in `dir` (the system
+            // temporary directory when empty) instead of dropping them, up to
+            // `disk_budget` bytes on disk, 0 meaning unbounded
+            void set_spill(bool enable, const QString &dir = QString(), size_t disk_budget = 0) {
+                m_spill_dir = dir;
+                m_disk_budget = disk_budget;
+
+                if (!enable && m_spill_enabled) {
+                    // spilled lines are the oldest ones, they go with the file
+                    while (m_resident > 0)
+                        drop_front();
+
+                    m_decoded.clear();
+                    close_spill();
                 }
 
-                // Now a single clean check
-                if (line < sl || line > el)
-                    return false;
+                m_spill_enabled = enable;
+                enforce_budget();
+            }
 
-                if (line == sl && col < sc)
-                    return false;
+            // bytes held in the spill file
+            size_t disk_usage() const {
+                return m_disk_bytes;
+            }
 
-                if (line == el && col > ec)
-                    return false;
+            // size of the spill file, free segments included. with a disk budget it
+            // stays within the budget plus two segments
+            size_t spill_file_size() const {
+                return m_segments.size() * static_cast<size_t>(HISTORY_SPILL_SEGMENT);
+            }
 
-                return true;
+            void set_budget(size_t budget) {
+                m_budget = budget;
+                enforce_budget();
             }
 
-            static int draw_callback(
-                struct tsm_screen* screen,
-                uint64_t id,
-                const uint32_t* ch,
-                size_t len,
-                unsigned int width,
-                unsigned int posx,
-                unsigned int posy,
-                const struct tsm_screen_attr* attr,
-                tsm_age_t age,
-                void* data
-            ) {
-                q_draw_context* ctx = static_cast<q_draw_context*>(data);
-                QPainter* painter = ctx->painter;
-                QonsoleWidget* self = ctx->widget;
-                
-                if (!self) {
-                    qDebug() << "tsm: invalid data passed.";
-                    return 0;
-                }
+            size_t budget() const {
+                return m_budget;
+            }
 
-                bool iss = self->is_selected(posx, posy);
+            // bytes held by encoded blocks
+            size_t memory_usage() const {
+                return m_bytes;
+            }
 
-                // if not empty cell or it's selected then draw it otherwise do not
-                // in case did not check if selecting, empty cells including spaces for some reason
-                // (libtsm) won't be drawn at all
-                if (len == 0 && !iss) {
-                    if (!self->m_draw_empty_cells) {
-                        return 0;
-                    }
+            size_t line_count() const {
+                return m_lines;
+            }
+
+            // absolute index of line 0, i.e. lines dropped for the budget so far
+            quint64 dropped_lines() const {
+                return m_dropped;
+            }
+
+            void clear() {
+                m_dropped += m_lines;
+                m_blocks.clear();
+                m_decoded.clear();
+                close_spill();
+                m_bytes = 0;
+                m_lines = 0;
+                m_resident = 0;
+                m_pending = q_history_line();
+                m_pending_cells = 0;
+            }
+
+            // build the next line cell by cell, in column order, combining marks
+            // included
+            void append_cell(const uint32_t *ch, size_t len, unsigned int width, const tsm_screen_attr &attr) {
+                if (len > 0 && ch) {
+                    len = qMin<size_t>(len, 0xFF);
+                    m_pending.cells.append(reinterpret_cast<const char32_t*>(ch), len);
+
+                    if (len > 1)
+                        m_pending.clusters.emplace_back(static_cast<uint16_t>(m_pending_cells), static_cast<uint8_t>(len));
                 }
-                
-                int x = posx * self->m_char_width;
-                int y = posy * self->m_char_height;
-                
-                // Get colors
-                QColor fg = self->m_default_fg;
-                QColor bg = self->m_default_bg;
-                
-                if (attr->fccode >= 0 && attr->fccode < 16) {
-                    fg = self->m_palette[attr->fccode];
+                else {
+                    m_pending.cells += U' ';
                 }
-                if (attr->bccode >= 0 && attr->bccode < 16) {
-                    bg = self->m_palette[attr->bccode];
+
+                m_pending_cells++;
+
+                if (!m_pending.runs.empty()) {
+                    q_history_run &last = m_pending.runs.back();
+
+                    if (last.width == width && last.cells < 0xFFFF && same_attr(last.attr, attr)) {
+                        last.cells++;
+                        return;
+                    }
                 }
-                
-                // Handle inverse
-                if (attr->inverse) {
-                    std::swap(fg, bg);
+
+                m_pending.runs.push_back({1, static_cast<uint8_t>(width), attr});
+            }
+
+            void end_line() {
+                // trailing blanks render as the default background anyway
+                while (!m_pending.runs.empty() && !m_pending.cells.empty()
+                       && m_pending.cells.back() == U' ' && blank_attr(m_pending.runs.back().attr)
+                       && (m_pending.clusters.empty() || m_pending.clusters.back().first + 1u != m_pending_cells)) {
+                    m_pending.cells.pop_back();
+                    m_pending_cells--;
+
+                    if (--m_pending.runs.back().cells == 0)
+                        m_pending.runs.pop_back();
                 }
-                
-                // Draw background
-                if (iss) {
-                    bg = self->m_selection_bg;
+
+                if (m_blocks.empty() || m_blocks.back().lines >= HISTORY_BLOCK_LINES)
+                    m_blocks.emplace_back();
+
+                q_block &tail = m_blocks.back();
+                int before = tail.data.size();
+
+                QByteArray text = utils::to_utf8(m_pending.cells);
+                encode(tail.data, m_pending, text);
+
+                for (int i = 0; i + 3 <= text.size(); ++i) {
+                    uint32_t bit = utils::gram_bit(text.constData() + i);
+                    tail.grams[bit / 64] |= uint64_t(1) << (bit % 64);
                 }
 
-                painter->fillRect(x, y, self->m_char_width * width, self->m_char_height, bg);
-                
-                // Draw character
-                QString text(EMPTY_CELL_REPLACEMENT);
-                
-                if (len > 0) {
-                    text = QString::fromUcs4(reinterpret_cast<const char32_t*>(ch), len);
+                tail.lines++;
+                m_bytes += tail.data.size() - before;
+                m_lines++;
+
+                // seal the block once full
+                if (tail.lines >= HISTORY_BLOCK_LINES && m_compress) {
+                    QByteArray packed = qCompress(tail.data, HISTORY_COMPRESSION_LEVEL);
+
+                    if (packed.size() < tail.data.size()) {
+                        m_bytes -= tail.data.size() - packed.size();
+                        tail.data = packed;
+                        tail.compressed = true;
+                    }
                 }
-                
-                QFont font = self->m_font;
 
-                if (self->m_use_bold && attr->bold)
-                    font.setBold(true);
+                m_pending = q_history_line();
+                m_pending_cells = 0;
+                enforce_budget();
+            }
 
-                if (attr->underline)
-                    font.setUnderline(true);
-                
-                painter->setFont(font);
-                painter->setPen(fg);
-                painter->drawText(x, y + self->m_char_height - 3, text);
-                
-                return 0;
+            size_t block_count() const {
+                return m_blocks.size();
             }
 
-            static void write_callback(struct tsm_vte* vte, const char* u8, size_t len, void* data) {
-                QonsoleWidget* self = static_cast<QonsoleWidget*>(data);
+            // false when no line of `block` contains `needle`, compared ASCII case
+            // folded. needles shorter than a trigram always pass
+            bool may_contain(size_t block, const QByteArray &needle) const {
+                const std::vector<uint64_t> &grams = m_blocks[block].grams;
 
-                if (self) {
-                    QByteArray output(u8, static_cast<int>(len));
-                    self->write_to_source(output);
+                for (int i = 0; i + 3 <= needle.size(); ++i) {
+                    uint32_t bit = utils::gram_bit(needle.constData() + i);
+
+                    if (!(grams[bit / 64] & (uint64_t(1) << (bit % 64))))
+                        return false;
                 }
+
+                return true;
             }
 
-            static int dump_callback(
-                struct tsm_screen *con,
-                uint64_t id,
-                const uint32_t *ch,
-                size_t len,
-                unsigned int width,
-                unsigned int posx,
-                unsigned int posy,
-                const struct tsm_screen_attr *attr,
-                tsm_age_t age,
-                void *data
-            ){
-                Q_UNUSED(con);
-                Q_UNUSED(id);
-                Q_UNUSED(width);
-                Q_UNUSED(attr);
-                Q_UNUSED(age);
-                
-                QString *output = static_cast<QString*>(data);
-                
-                // Calculate current position in output string
-                unsigned int screenWidth = tsm_screen_get_width(con);
-                unsigned int currentPos = posy * (screenWidth + 1) + posx; // +1 for newline
-                
-                // Expand string if needed
-                while (output->length() <= (int)currentPos) {
-                    output->append(' ');
-                }
-                
-                // Convert UCS4 character to QString
-                QString charStr;
-                if (len > 0 && ch != nullptr) {
-                    charStr = QString::fromUcs4(reinterpret_cast<const char32_t*>(ch), static_cast<int>(len));
-                }
-                
-                // Handle empty cells
-                if (charStr.isEmpty()) {
-                    charStr = " ";
-                }
-                
-                // Replace character at position
-                if (posx < screenWidth) {
-                    output->replace(currentPos, charStr.length(), charStr);
-                }
-                
-                // Add newline at end of line
-                if (posx == screenWidth - 1) {
-                    unsigned int newlinePos = posy * (screenWidth + 1) + screenWidth;
-                    if (output->length() <= (int)newlinePos) {
-                        output->append('\n');
-                    } else {
-                        output->replace(newlinePos, 1, "\n");
-                    }
+            // call fn(index, text, len) with the UTF-8 text of each line of `block`,
+            // without decoding cells and attributes
+            template<typename F>
+            void scan_block(size_t block, F fn) {
+                const q_block &b = m_blocks[block];
+                QByteArray data = b.compressed ? qUncompress(bytes(b)) : bytes(b);
+
+                const uchar *p = reinterpret_cast<const uchar*>(data.constData());
+                const uchar *end = p + data.size();
+                size_t index = block * HISTORY_BLOCK_LINES;
+
+                while (p + 8 <= end) {
+                    uint16_t runs = get_u16(p);
+                    uint32_t text = get_u32(p + 2);
+                    uint16_t clusters = get_u16(p + 6);
+                    p += 8 + static_cast<size_t>(runs) * 12 + static_cast<size_t>(clusters) * 3;
+
+                    if (p + text > end)
+                        break;
+
+                    fn(index++, reinterpret_cast<const char*>(p), static_cast<size_t>(text));
+                    p += text;
                 }
-                
-                return 0;
             }
 
-            void on_data_ready(QByteArray data) {
-                if (m_vte) {
-                    tsm_vte_input(m_vte, data.constData(), data.size());
+            // copy line `index`, 0 being the oldest line kept
+            bool line(size_t index, q_history_line &out) {
+                if (index >= m_lines)
+                    return false;
 
-                    // Only update cursor and auto-scroll if we're at the bottom
-                    if (m_scroll_offset == 0) {
-                        update_cursor_pos();
-                    }
+                const std::vector<q_history_line> &lines = decoded(index / HISTORY_BLOCK_LINES);
+                size_t offset = index % HISTORY_BLOCK_LINES;
 
-                    update();
-                }
+                if (offset >= lines.size())
+                    return false;
+
+                out = lines[offset];
+                return true;
             }
+    };
 
-            void load_default_palette() {
-                // Default theme: Credit to <https://draculatheme.com/>
-                m_palette[0]  = QColor("#21222C"); // Black
+    // a search hit, lines count from the oldest scrollback line with the screen
+    // rows following the scrollback
+    struct q_search_match {
+        quint64 line = 0;  // stays on the same text as lines move to the scrollback
+        int start_column = 0;
+        int end_column = 0;
+        bool valid = false;
+    };
+
+    // literal or regular expression matcher over UTF-8 lines, reporting matches
+    // as (codepoint offset, codepoint length)
+    class q_search_pattern {
+        QByteArray m_needle;
+        QRegularExpression m_regex;
+        bool m_literal;
+        bool m_case_sensitive;
+
+        mutable QByteArray m_folded;
+
+        public:
+            q_search_pattern(const QString &pattern, bool regex, bool case_sensitive)
+                : m_needle(pattern.toUtf8()), m_case_sensitive(case_sensitive) {
+                bool ascii = true;
+                for (char c : m_needle)
+                    ascii = ascii && static_cast<uchar>(c) < 0x80;
+
+                // literals are scanned bytewise, folding only covers ASCII
+                m_literal = !regex && (case_sensitive || ascii);
+
+                if (m_literal) {
+                    if (!case_sensitive) {
+                        for (int i = 0; i < m_needle.size(); ++i)
+                            m_needle[i] = utils::fold_ascii(m_needle[i]);
+                    }
+                }
+                else {
+                    m_regex = QRegularExpression(
+                        regex ? pattern : QRegularExpression::escape(pattern),
+                        case_sensitive ? QRegularExpression::NoPatternOption : QRegularExpression::CaseInsensitiveOption
+                    );
+                }
+            }
+
+            bool valid() const {
+                return m_literal ? !m_needle.isEmpty() : m_regex.isValid();
+            }
+
+            // literal usable with the scrollback trigram filter, empty otherwise
+            QByteArray needle() const {
+                return m_literal ? m_needle : QByteArray();
+            }
+
+            void find(const char *text, size_t len, std::vector<std::pair<int, int>> &out) const {
+                out.clear();
+
+                if (m_literal) {
+                    const char *hay = text;
+
+                    if (!m_case_sensitive) {
+                        m_folded.resize(static_cast<int>(len));
+                        for (size_t i = 0; i < len; ++i)
+                            m_folded[i] = utils::fold_ascii(text[i]);
+                        hay = m_folded.constData();
+                    }
+
+                    size_t n = m_needle.size();
+                    const char *end = hay + len;
+                    const char *p = hay;
+                    const char *counted = hay;
+                    int cp = 0;
+
+                    // memchr skips to candidates for the first byte, vectorized by libc
+                    while (static_cast<size_t>(end - p) >= n) {
+                        p = static_cast<const char*>(memchr(p, m_needle[0], (end - p) - n + 1));
+
+                        if (!p)
+                            break;
+
+                        if (memcmp(p, m_needle.constData(), n) != 0) {
+                            ++p;
+                            continue;
+                        }
+
+                        for (; counted < p; ++counted)
+                            cp += (*counted & 0xC0) != 0x80;
+
+                        int length = 0;
+                        for (const char *q = p; q < p + n; ++q)
+                            length += (*q & 0xC0) != 0x80;
+
+                        out.emplace_back(cp, length);
+                        p += n;
+                    }
+
+                    return;
+                }
+
+                QString line = QString::fromUtf8(text, static_cast<qsizetype>(len));
+                const ushort *u = line.utf16();
+                qsizetype pos = 0;
+                qsizetype counted = 0;
+                int cp = 0;
+
+                while (pos <= line.size()) {
+                    QRegularExpressionMatch match = m_regex.match(line, pos);
+
+                    if (!match.hasMatch())
+                        break;
+
+                    qsizetype start = match.capturedStart();
+                    qsizetype stop = match.capturedEnd();
+
+                    // empty matches select nothing
+                    if (stop == start) {
+                        pos = stop + 1;
+                        continue;
+                    }
+
+                    // low surrogates do not start a codepoint
+                    for (; counted < start; ++counted)
+                        cp += (u[counted] & 0xFC00) != 0xDC00;
+
+                    int length = 0;
+                    for (qsizetype i = start; i < stop; ++i)
+                        length += (u[i] & 0xFC00) != 0xDC00;
+
+                    out.emplace_back(cp, length);
+                    pos = stop;
+                }
+            }
+    };
+
+    // lock-free single producer / single consumer byte ring. the storage is not
+    // zero-filled, so the OS only backs the pages output actually reached
+    class q_byte_ring {
+        std::unique_ptr<char[]> m_data;
+        size_t m_capacity;
+        size_t m_mask;
+
+        // head is only written by the producer, tail only by the consumer
+        alignas(64) std::atomic<size_t> m_head {0};
+        alignas(64) std::atomic<size_t> m_tail {0};
+
+        public:
+            explicit q_byte_ring(size_t capacity) {
+                size_t c = 1;
+                while (c < capacity) c <<= 1;
+
+                m_data.reset(new char[c]);
+                m_capacity = c;
+                m_mask = c - 1;
+            }
+
+            size_t capacity() const {
+                return m_capacity;
+            }
+
+            size_t size() const {
+                return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+            }
+
+            bool empty() const {
+                return size() == 0;
+            }
+
+            // producer: copy as much of src as fits, returns bytes written
+            size_t write(const char *src, size_t len) {
+                size_t head = m_head.load(std::memory_order_relaxed);
+                size_t tail = m_tail.load(std::memory_order_acquire);
+
+                size_t n = qMin(len, capacity() - (head - tail));
+                size_t off = head & m_mask;
+                size_t first = qMin(n, capacity() - off);
+
+                memcpy(m_data.get() + off, src, first);
+                memcpy(m_data.get(), src + first, n - first);
+
+                m_head.store(head + n, std::memory_order_release);
+                return n;
+            }
+
+            // consumer: contiguous readable span, call consume() once done with it
+            const char* peek(size_t &len) const {
+                size_t tail = m_tail.load(std::memory_order_relaxed);
+                size_t head = m_head.load(std::memory_order_acquire);
+
+                size_t off = tail & m_mask;
+                len = qMin(head - tail, capacity() - off);
+
+                return m_data.get() + off;
+            }
+
+            void consume(size_t len) {
+                m_tail.store(m_tail.load(std::memory_order_relaxed) + len, std::memory_order_release);
+            }
+    };
+
+    // counters kept by a reader, safe to read from any thread
+    struct q_reader_stats {
+        quint64 bytes_read = 0;
+        quint64 reads = 0;
+        quint64 signals_emitted = 0;  // data_ready() emissions, the opt-in per-read copies
+        quint64 notifications = 0;    // data_available() emissions, at most one in flight
+        quint64 ring_full_waits = 0;  // times the reader waited for room in the ring
+        size_t queued_bytes = 0;      // read but not parsed yet
+        bool notify_pending = false;  // a data_available() is queued for the consumer
+    };
+
+    // runtime counters of a widget, see QonsoleWidget::stats(). they are
+    // cumulative, rates come from two snapshots and their timestamps
+    struct q_stats {
+        qint64 msecs = 0;             // when the snapshot was taken, since the terminal was created
+        q_reader_stats reader;
+        size_t backlog_bytes = 0;     // read or held back while suspended, not parsed yet
+        quint64 parsed_notifications = 0;  // parsed() emissions of the parser thread
+
+        quint64 parsed_bytes = 0;
+        quint64 parse_chunks = 0;
+        qint64 parse_nsecs = 0;       // total
+        qint64 max_parse_nsecs = 0;   // longest chunk
+
+        quint64 frames = 0;
+        qint64 paint_nsecs = 0;       // total
+        qint64 last_paint_nsecs = 0;
+        qint64 max_paint_nsecs = 0;
+
+        quint64 cells_drawn = 0;
+        quint64 cells_skipped = 0;    // empty or outside the paint region
+
+        size_t write_queue_bytes = 0;
+        quint64 write_stalls = 0;     // times the writer waited on the source
+        quint64 write_congestions = 0;  // times the queue crossed the high watermark
+
+        // reads per second between an earlier snapshot and this one
+        double reads_per_second(const q_stats &earlier) const {
+            qint64 elapsed = msecs - earlier.msecs;
+            return elapsed > 0 ? (reader.reads - earlier.reader.reads) * 1000.0 / elapsed : 0;
+        }
+    };
+
+    // trace events in the Chrome trace event format, which Perfetto and
+    // chrome://tracing load. safe to use from any thread
+    class QonsoleTrace {
+        QFile m_file;
+        QMutex m_lock;
+        QElapsedTimer m_clock;
+        bool m_first = true;
+
+        public:
+            QonsoleTrace() {
+                m_clock.start();
+            }
+
+            ~QonsoleTrace() {
+                if (m_file.isOpen())
+                    m_file.write("\n]\n");
+            }
+
+            bool open(const QString &path) {
+                m_file.setFileName(path);
+
+                if (!m_file.open(QFile::WriteOnly | QFile::Truncate))
+                    return false;
+
+                m_file.write("[\n");
+                return true;
+            }
+
+            // nanoseconds since the trace started
+            qint64 now() const {
+                return m_clock.nsecsElapsed();
+            }
+
+            // a span of `duration` nanoseconds starting at `start`, with an
+            // optional count attached
+            void complete(const char *name, qint64 start, qint64 duration, const char *arg = nullptr, qint64 value = 0) {
+                QByteArray event;
+                event.reserve(160);
+
+                event += "{\"name\":\"";
+                event += name;
+                event += "\",\"cat\":\"qonsole\",\"ph\":\"X\",\"pid\":1,\"tid\":";
+                event += QByteArray::number(static_cast<qulonglong>(reinterpret_cast<quintptr>(QThread::currentThreadId())));
+                event += ",\"ts\":";
+                event += QByteArray::number(start / 1000.0, 'f', 3);
+                event += ",\"dur\":";
+                event += QByteArray::number(duration / 1000.0, 'f', 3);
+
+                if (arg) {
+                    event += ",\"args\":{\"";
+                    event += arg;
+                    event += "\":";
+                    event += QByteArray::number(value);
+                    event += "}";
+                }
+
+                event += "}";
+
+                QMutexLocker locker(&m_lock);
+
+                if (!m_first)
+                    m_file.write(",\n");
+
+                m_first = false;
+                m_file.write(event);
+            }
+    };
+
+    // records of a session recording, see QonsoleRecorder
+    enum q_record_type {
+        RECORD_DATA = 0,      // output as the terminal parsed it
+        RECORD_RESIZE = 1,    // columns and lines as varints
+        RECORD_KEYFRAME = 2,  // columns and lines as varints, then output redrawing the screen
+    };
+
+    enum q_replay_speed {
+        REAL_TIME,     // at the pace it was recorded
+        FAST_FORWARD,  // as fast as the terminal parses
+    };
+
+    // append-only session recording: "QREC", a version byte and the initial
+    // columns and lines as varints, then records of a type byte, the microseconds
+    // since the previous record and the payload length as varints, and the
+    // payload. records are buffered and written out with every keyframe and
+    // once RECORD_FLUSH_INTERVAL passed, so a crash loses at most that much
+    class QonsoleRecorder {
+        QFile m_file;
+        QElapsedTimer m_clock;
+        qint64 m_last = 0;            // microseconds at the previous record
+        qint64 m_flushed = 0;         // microseconds at the previous flush
+        size_t m_since_keyframe = 0;  // output bytes since the last keyframe
+
+        void write(q_record_type type, const char *payload, size_t len) {
+            qint64 now = m_clock.nsecsElapsed() / 1000;
+
+            QByteArray head;
+            head.append(static_cast<char>(type));
+            utils::put_varint(head, now - m_last);
+            utils::put_varint(head, len);
+            m_last = now;
+
+            m_file.write(head);
+            m_file.write(payload, len);
+
+            if (type == RECORD_KEYFRAME || now - m_flushed >= RECORD_FLUSH_INTERVAL * 1000LL) {
+                m_file.flush();
+                m_flushed = now;
+            }
+        }
+
+        public:
+            static constexpr char version = 1;
+
+            bool open(const QString &path, int cols, int lines) {
+                m_file.setFileName(path);
+
+                if (!m_file.open(QFile::WriteOnly | QFile::Truncate))
+                    return false;
+
+                QByteArray header("QREC");
+                header.append(version);
+                utils::put_varint(header, cols);
+                utils::put_varint(header, lines);
+
+                m_clock.start();
+                return m_file.write(header) == header.size();
+            }
+
+            void data(const char *data, size_t len) {
+                write(RECORD_DATA, data, len);
+                m_since_keyframe += len;
+            }
+
+            void resize(int cols, int lines) {
+                QByteArray size;
+                utils::put_varint(size, cols);
+                utils::put_varint(size, lines);
+
+                write(RECORD_RESIZE, size.constData(), size.size());
+            }
+
+            bool keyframe_due() const {
+                return m_since_keyframe >= RECORD_KEYFRAME_INTERVAL;
+            }
+
+            void keyframe(int cols, int lines, const QByteArray &screen) {
+                QByteArray frame;
+                utils::put_varint(frame, cols);
+                utils::put_varint(frame, lines);
+                frame += screen;
+
+                write(RECORD_KEYFRAME, frame.constData(), frame.size());
+                m_since_keyframe = 0;
+            }
+    };
+
+    class QonsoleMultiplexer;
+
+    // threaded reader
+    class QonsoleReader : public QThread {
+        Q_OBJECT
+
+        friend class QonsoleMultiplexer;
+
+        std::atomic<bool> __running = false;
+
+        // when set, reads are served by the multiplexer instead of run()
+        QonsoleMultiplexer *m_multiplexer = nullptr;
+
+        // set while the multiplexer has parked this reader on a full ring, so
+        // consumed() knows to wake it
+        std::atomic<bool> m_parked = false;
+
+        // output is handed to the gui thread through the ring, a single
+        // notification is in flight until the consumer acknowledges it
+        q_byte_ring m_ring {RING_BUFFER_SIZE};
+        std::atomic<bool> m_notify_pending = false;
+
+        // a reader thread facing a full ring sleeps on m_room until consumed()
+        QMutex m_room_lock;
+        QWaitCondition m_room;
+        std::atomic<bool> m_room_wanted = false;
+
+        // read size: the configured base, grown up to the adaptive limit
+        // while reads keep filling the buffer
+        std::atomic<size_t> m_buffer_size {BUFFER_SIZE};
+        std::atomic<size_t> m_max_buffer_size {MAX_BUFFER_SIZE};
+        std::atomic<bool> m_adaptive_buffer = false;
+
+        std::vector<char> m_buffer;
+        size_t m_read_size = 0;
+        int m_full_reads = 0;
+        int m_short_reads = 0;
+
+        std::atomic<quint64> m_bytes_read {0};
+        std::atomic<quint64> m_reads {0};
+        std::atomic<quint64> m_signals_emitted {0};
+        std::atomic<quint64> m_notifications {0};
+        std::atomic<quint64> m_ring_full_waits {0};
+
+        public:
+
+            #if defined(__linux__) || defined(__APPLE__)
+            const int file_descriptor = 0;
+
+            #elif defined(_WIN32)
+            const union {
+                HANDLE handle = INVALID_HANDLE_VALUE;     // for file handles
+                SOCKET socket = INVALID_SOCKET;      // for socket handles
+            };
+            bool is_socket = false; // flag to identify handle type
+            #endif
+
+            // unix-like constructor
+            #if defined(__linux__) || defined(__APPLE__)
+            QonsoleReader(int fd) : file_descriptor(fd) {}
+
+            #elif defined(_WIN32)
+            // file handle constructor
+            QonsoleReader(HANDLE h) {
+                this->handle = h;
+                this->is_socket = false;
+            }
+            // socket handle constructor
+            QonsoleReader(SOCKET s) {
+                this->socket = s;
+                this->is_socket = true;
+            }
+            #endif
+
+            ~QonsoleReader();
+
+            // general
+            bool is_running() {
+                return __running.load();
+            }
+
+            // serve this reader from a shared multiplexer thread instead of a thread
+            // of its own, must be called before start_reading()
+            void set_multiplexer(QonsoleMultiplexer *mux) {
+                m_multiplexer = mux;
+            }
+
+            // start the reader thread, or register with the multiplexer if one is
+            // set and supports this source (falls back to the thread otherwise)
+            void start_reading();
+
+            // one write to the source, returns bytes written or -1 on error
+            ssize_t write_source(const char *data, size_t len) {
+                #if defined(__linux__) || defined(__APPLE__)
+                    if (file_descriptor > 0) {
+                        return write(file_descriptor, data, len);
+                    }
+                #elif defined(_WIN32)
+                    if (is_socket) {
+                        // write to socket
+                        return send(socket, data, static_cast<int>(len), 0);
+                    } else {
+                        // write to handle (pipe/file)
+                        DWORD bytes_written = 0;
+                        if (WriteFile(handle, data, static_cast<DWORD>(len), &bytes_written, nullptr)) {
+                            return bytes_written;
+                        }
+                    }
+                #endif
+                return -1; // error
+            }
+
+            // wait up to timeout for the source to accept data, false if it
+            // still doesn't. errors and hangups count as writable so the next
+            // write reports them
+            bool wait_writable(int timeout) {
+                #if defined(__linux__) || defined(__APPLE__)
+                    struct pollfd pfd { file_descriptor, POLLOUT, 0 };
+                    return poll(&pfd, 1, timeout) > 0;
+                #elif defined(_WIN32)
+                    Q_UNUSED(timeout);
+                    QThread::msleep(1);
+                    return true;
+                #endif
+            }
+
+            // largest write that can't block once wait_writable() returned true:
+            // anything on a non-blocking source, PIPE_BUF on a blocking one, whose
+            // reads stay blocking for the reader thread
+            size_t write_limit() const {
+                #if defined(__linux__) || defined(__APPLE__)
+                    int flags = fcntl(file_descriptor, F_GETFL);
+                    if (flags >= 0 && !(flags & O_NONBLOCK))
+                        return PIPE_BUF;
+                #endif
+                return SIZE_MAX;
+            }
+
+            q_byte_ring& ring() {
+                return m_ring;
+            }
+
+            // consumer side: called before draining the ring, so bytes written
+            // afterwards trigger a new data_available()
+            void acknowledge() {
+                m_notify_pending.store(false);
+            }
+
+            // consumer side: called after consuming from the ring, wakes the reader
+            // thread or the multiplexer if either waits for room
+            void consumed();
+
+            q_reader_stats stats() const {
+                q_reader_stats s;
+                s.bytes_read = m_bytes_read;
+                s.reads = m_reads;
+                s.signals_emitted = m_signals_emitted;
+                s.notifications = m_notifications;
+                s.ring_full_waits = m_ring_full_waits;
+                s.queued_bytes = m_ring.size();
+                s.notify_pending = m_notify_pending;
+                return s;
+            }
+
+            // bytes requested per read, takes effect on the next read
+            void set_buffer_size(size_t size) {
+                m_buffer_size = qMax<size_t>(size, 1);
+            }
+
+            size_t get_buffer_size() const {
+                return m_buffer_size;
+            }
+
+            // grow the read size (up to max_size) while reads keep filling the
+            // buffer, and shrink it back to the base size for interactive traffic
+            void set_adaptive_buffer(bool s, size_t max_size = MAX_BUFFER_SIZE) {
+                m_max_buffer_size = qMax<size_t>(max_size, 1);
+                m_adaptive_buffer = s;
+            }
+
+        protected:
+            // reading thread only: buffer sized for the next read
+            char* read_buffer() {
+                size_t base = m_buffer_size;
+
+                if (!m_adaptive_buffer || m_read_size < base) {
+                    m_read_size = base;
+                }
+                else {
+                    m_read_size = qMin(m_read_size, qMax(base, m_max_buffer_size.load()));
+                }
+
+                if (m_buffer.size() < m_read_size) {
+                    m_buffer.resize(m_read_size);
+                }
+
+                return m_buffer.data();
+            }
+
+            size_t read_size() const {
+                return m_read_size;
+            }
+
+            // feed the adaptive sizing with the outcome of the last read
+            void record_read(size_t bytes_read) {
+                if (!m_adaptive_buffer)
+                    return;
+
+                size_t base = m_buffer_size;
+                size_t limit = qMax(base, m_max_buffer_size.load());
+
+                if (bytes_read >= m_read_size) {
+                    m_short_reads = 0;
+
+                    // bulk output: double after two consecutive full reads
+                    if (++m_full_reads >= 2 && m_read_size < limit) {
+                        m_read_size = qMin(m_read_size * 2, limit);
+                        m_full_reads = 0;
+                    }
+                }
+                else if (bytes_read < m_read_size / 4) {
+                    m_full_reads = 0;
+
+                    // interactive traffic: halve after a few small reads
+                    if (++m_short_reads >= 4 && m_read_size > base) {
+                        m_read_size = qMax(m_read_size / 2, base);
+                        m_short_reads = 0;
+                    }
+                }
+                else {
+                    m_full_reads = 0;
+                    m_short_reads = 0;
+                }
+            }
+
+            // one read from the source, -1 on error
+            ssize_t read_source(char *buffer, size_t len) {
+                #if defined(__linux__) || defined(__APPLE__)
+                return read(this->file_descriptor, buffer, len);
+                #elif defined(_WIN32)
+                if (is_socket) {
+                    return recv(socket, buffer, static_cast<int>(len), 0);
+                }
+
+                DWORD bytes_read = 0;
+                if (!ReadFile(handle, buffer, static_cast<DWORD>(len), &bytes_read, nullptr)) {
+                    DWORD error = GetLastError();
+                    return (error == ERROR_BROKEN_PIPE || error == ERROR_HANDLE_EOF) ? 0 : -1;
+                }
+                return bytes_read;
+                #endif
+            }
+
+        public:
+            // last read or write failed only because the source wasn't ready
+            static bool would_block() {
+                #if defined(__linux__) || defined(__APPLE__)
+                return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+                #elif defined(_WIN32)
+                return WSAGetLastError() == WSAEWOULDBLOCK;
+                #endif
+            }
+
+        protected:
+            bool can_accept() const {
+                return m_ring.size() < m_ring.capacity();
+            }
+
+            // multiplexed mode: a single read once the source is readable, never
+            // blocks on a full ring. false once the source is closed
+            bool service() {
+                char *buffer = read_buffer();
+                size_t room = m_ring.capacity() - m_ring.size();
+
+                ssize_t bytes_read = read_source(buffer, qMin(read_size(), room));
+
+                if (bytes_read > 0) {
+                    record_read(bytes_read);
+                    publish(buffer, bytes_read);
+                    return true;
+                }
+                else if (bytes_read < 0 && would_block()) {
+                    return true;
+                }
+
+                qDebug() << (bytes_read == 0 ? "End of file reached." : "Error reading from source.");
+                __running = false;
+
+                return false;
+            }
+
+            // hand a chunk to the consumer, blocks while the ring is full so a
+            // fast producer gets throttled instead of ballooning memory. the wait
+            // ends when the consumer makes room, RING_FULL_WAIT is only a backstop.
+            // the copy for data_ready() is only made while something listens to it
+            void publish(const char *data, size_t len) {
+                m_bytes_read += len;
+                m_reads++;
+
+                if (isSignalConnected(QMetaMethod::fromSignal(&QonsoleReader::data_ready))) {
+                    m_signals_emitted++;
+                    emit data_ready(QByteArray(data, static_cast<int>(len)));
+                }
+
+                while (len > 0) {
+                    size_t n = m_ring.write(data, len);
+                    data += n;
+                    len -= n;
+
+                    if (n > 0 && !m_notify_pending.exchange(true)) {
+                        m_notifications++;
+                        emit data_available();
+                    }
+
+                    if (len > 0) {
+                        m_ring_full_waits++;
+
+                        QMutexLocker locker(&m_room_lock);
+                        m_room_wanted.store(true, std::memory_order_relaxed);
+                        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+                        if (m_ring.size() >= m_ring.capacity())
+                            m_room.wait(&m_room_lock, RING_FULL_WAIT);
+
+                        m_room_wanted.store(false, std::memory_order_relaxed);
+                    }
+                }
+            }
+
+            // read up to read_size() bytes at a time and publish them, until the
+            // source is closed or fails
+            void run() override {
+                if (is_running()) {
+                    qDebug() << "reader already running!";
+                    return;
+                }
+
+                qDebug() << "reader running ...";
+
+                #if defined(__linux__) || defined(__APPLE__)
+                qDebug() << "reading ...";
+
+                // read and emit
+                while (true) {
+                    char *buffer = read_buffer();
+
+                    ssize_t bytes_read = read(this->file_descriptor, buffer, read_size());
+
+                    if (bytes_read > 0) {
+                        record_read(bytes_read);
+                        publish(buffer, bytes_read);
+
+                    } else if (bytes_read == 0) {
+                        qDebug() << "End of file reached.";
+                        break;
+                    } else {
+                        qDebug() << "Error reading from file descriptor.";
+                        break;
+                    }
+                }
+
+                qDebug() << "done reading.";
+                #elif defined(_WIN32)
+                // check if using socket or file handle
+                if (is_socket) {
+                    qDebug() << "reading from socket:" << socket;
+                    
+                    while (__running) {
+                        char *buffer = read_buffer();
+                        int bytes_read = recv(socket, buffer, static_cast<int>(read_size()), 0);
+                        
+                        if (bytes_read > 0) {
+                            record_read(bytes_read);
+                            publish(buffer, bytes_read);
+                        } else if (bytes_read == 0) {
+                            qDebug() << "Socket closed.";
+                            break;
+                        } else {
+                            int error = WSAGetLastError();
+                            if (error == WSAEWOULDBLOCK) {
+                                QThread::msleep(10);
+                                continue;
+                            }
+                            qDebug() << "Error reading from socket:" << error;
+                            break;
+                        }
+                    }
+                } else {
+                    qDebug() << "reading from handle:" << handle;
+                    
+                    while (__running) {
+                        char *buffer = read_buffer();
+                        DWORD bytes_read = 0;
+                        
+                        if (ReadFile(handle, buffer, static_cast<DWORD>(read_size()), &bytes_read, nullptr)) {
+                            if (bytes_read > 0) {
+                                record_read(bytes_read);
+                                publish(buffer, bytes_read);
+                            }
+                        } else {
+                            DWORD error = GetLastError();
+                            if (error == ERROR_BROKEN_PIPE || error == ERROR_HANDLE_EOF) {
+                                qDebug() << "Pipe closed.";
+                                break;
+                            }
+                            qDebug() << "Error reading from handle:" << error;
+                            break;
+                        }
+                    }
+                }
+                
+                qDebug() << "done reading.";
+                #endif
+                
+                __running = false;
+            }
+
+            
+        signals:
+            // emitted once new bytes are in the ring, until acknowledge() is called
+            void data_available();
+
+            // legacy per-read copy of the output, opt-in: only emitted while connected,
+            // costing an allocation per read. the terminal drains the ring instead
+            void data_ready(QByteArray data);
+    };
+
+    // one thread serving many readers through the OS poller: epoll on linux,
+    // kqueue on macOS and WSAEventSelect on windows (sockets only, at most 63
+    // per multiplexer). readers with a full ring are parked until it drains
+    class QonsoleMultiplexer : public QThread {
+        Q_OBJECT
+
+        friend class QonsoleReader;
+
+        QMutex m_lock;
+        std::vector<QonsoleReader*> m_readers;
+        std::vector<QonsoleReader*> m_throttled;
+        std::atomic<bool> m_stopping = false;
+
+        #if defined(__linux__) || defined(__APPLE__)
+        int m_poll_fd = -1;
+        int m_wake_fd[2] = {-1, -1};   // eventfd on linux uses only the first slot
+        #elif defined(_WIN32)
+        HANDLE m_wake_event = nullptr;
+        QHash<QonsoleReader*, WSAEVENT> m_events;
+
+        // events of removed readers, closed by the poll thread once it is out of
+        // the wait that may still be using them
+        std::vector<WSAEVENT> m_retired;
+        #endif
+
+        public:
+            QonsoleMultiplexer() {
+                #if defined(__linux__)
+                m_poll_fd = epoll_create1(EPOLL_CLOEXEC);
+                m_wake_fd[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+                if (m_poll_fd >= 0 && m_wake_fd[0] >= 0) {
+                    epoll_event ev {};
+                    ev.events = EPOLLIN;
+                    ev.data.ptr = nullptr;
+                    epoll_ctl(m_poll_fd, EPOLL_CTL_ADD, m_wake_fd[0], &ev);
+                }
+                #elif defined(__APPLE__)
+                m_poll_fd = kqueue();
+
+                if (m_poll_fd >= 0 && pipe(m_wake_fd) == 0) {
+                    struct kevent ev;
+                    EV_SET(&ev, m_wake_fd[0], EVFILT_READ, EV_ADD, 0, 0, nullptr);
+                    kevent(m_poll_fd, &ev, 1, nullptr, 0, nullptr);
+                }
+                #elif defined(_WIN32)
+                m_wake_event = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+                #endif
+            }
+
+            ~QonsoleMultiplexer() {
+                stop();
+
+                #if defined(__linux__) || defined(__APPLE__)
+                if (m_poll_fd >= 0) close(m_poll_fd);
+                if (m_wake_fd[0] >= 0) close(m_wake_fd[0]);
+                if (m_wake_fd[1] >= 0) close(m_wake_fd[1]);
+                #elif defined(_WIN32)
+                for (WSAEVENT e : m_events) WSACloseEvent(e);
+                close_retired();
+                if (m_wake_event) CloseHandle(m_wake_event);
+                #endif
+            }
+
+            // start serving a reader, false if its source can not be multiplexed.
+            // unix sources are switched to non-blocking, so a read the poll woke
+            // us for can never stall the other readers
+            bool add(QonsoleReader *r) {
+                QMutexLocker locker(&m_lock);
+
+                if (!watch(r))
+                    return false;
+
+                #if defined(__linux__) || defined(__APPLE__)
+                int flags = fcntl(r->file_descriptor, F_GETFL);
+                if (flags >= 0)
+                    fcntl(r->file_descriptor, F_SETFL, flags | O_NONBLOCK);
+                #endif
+
+                m_readers.push_back(r);
+                r->__running = true;
+                locker.unlock();
+
+                if (!isRunning())
+                    start();
+
+                wake();
+                return true;
+            }
+
+            // stop serving a reader, once this returns the poll thread won't touch it
+            void remove(QonsoleReader *r) {
+                QMutexLocker locker(&m_lock);
+
+                auto it = std::find(m_readers.begin(), m_readers.end(), r);
+                if (it == m_readers.end())
+                    return;
+
+                m_readers.erase(it);
+                m_throttled.erase(std::remove(m_throttled.begin(), m_throttled.end(), r), m_throttled.end());
+                r->m_parked = false;
+                unwatch(r);
+
+                #if defined(_WIN32)
+                if (m_events.contains(r)) m_retired.push_back(m_events.take(r));
+                #endif
+
+                r->__running = false;
+                locker.unlock();
+
+                wake();
+            }
+
+            void stop() {
+                m_stopping = true;
+                wake();
+                wait();
+            }
+
+            int reader_count() {
+                QMutexLocker locker(&m_lock);
+                return static_cast<int>(m_readers.size());
+            }
+
+        protected:
+            // caller holds m_lock
+            bool watch(QonsoleReader *r) {
+                #if defined(__linux__)
+                epoll_event ev {};
+                ev.events = EPOLLIN;
+                ev.data.ptr = r;
+                return m_poll_fd >= 0 && epoll_ctl(m_poll_fd, EPOLL_CTL_ADD, r->file_descriptor, &ev) == 0;
+                #elif defined(__APPLE__)
+                struct kevent ev;
+                EV_SET(&ev, r->file_descriptor, EVFILT_READ, EV_ADD, 0, 0, r);
+                return m_poll_fd >= 0 && kevent(m_poll_fd, &ev, 1, nullptr, 0, nullptr) == 0;
+                #elif defined(_WIN32)
+                // pipe handles can't be waited on for readability
+                if (!r->is_socket)
+                    return false;
+
+                if (!m_events.contains(r)) {
+                    if (m_events.size() >= MAXIMUM_WAIT_OBJECTS - 1)
+                        return false;
+
+                    m_events.insert(r, WSACreateEvent());
+                }
+
+                return WSAEventSelect(r->socket, m_events.value(r), FD_READ | FD_CLOSE) == 0;
+                #endif
+            }
+
+            // caller holds m_lock
+            void unwatch(QonsoleReader *r) {
+                #if defined(__linux__)
+                epoll_ctl(m_poll_fd, EPOLL_CTL_DEL, r->file_descriptor, nullptr);
+                #elif defined(__APPLE__)
+                struct kevent ev;
+                EV_SET(&ev, r->file_descriptor, EVFILT_READ, EV_DELETE, 0, 0, nullptr);
+                kevent(m_poll_fd, &ev, 1, nullptr, 0, nullptr);
+                #elif defined(_WIN32)
+                if (m_events.contains(r)) WSAEventSelect(r->socket, m_events.value(r), 0);
+                #endif
+            }
+
+            #if defined(_WIN32)
+            // caller holds m_lock, or the poll thread is gone
+            void close_retired() {
+                for (WSAEVENT e : m_retired) WSACloseEvent(e);
+                m_retired.clear();
+            }
+            #endif
+
+            void wake() {
+                #if defined(__linux__)
+                uint64_t one = 1;
+                if (m_wake_fd[0] >= 0) {
+                    ssize_t ret = ::write(m_wake_fd[0], &one, sizeof(one));
+                    Q_UNUSED(ret);
+                }
+                #elif defined(__APPLE__)
+                char one = 1;
+                if (m_wake_fd[1] >= 0) {
+                    ssize_t ret = ::write(m_wake_fd[1], &one, 1);
+                    Q_UNUSED(ret);
+                }
+                #elif defined(_WIN32)
+                if (m_wake_event) SetEvent(m_wake_event);
+                #endif
+            }
+
+            // block until readers are readable or the timeout (ms, -1 = none) expires
+            void wait_ready(std::vector<QonsoleReader*> &ready, int timeout) {
+                ready.clear();
+
+                #if defined(__linux__)
+                epoll_event events[64];
+                int n = epoll_wait(m_poll_fd, events, 64, timeout);
+
+                for (int i = 0; i < n; ++i) {
+                    if (events[i].data.ptr) {
+                        ready.push_back(static_cast<QonsoleReader*>(events[i].data.ptr));
+                    }
+                    else {
+                        uint64_t count;
+                        ssize_t ret = ::read(m_wake_fd[0], &count, sizeof(count));
+                        Q_UNUSED(ret);
+                    }
+                }
+                #elif defined(__APPLE__)
+                struct kevent events[64];
+                struct timespec ts { timeout / 1000, (timeout % 1000) * 1000000 };
+                int n = kevent(m_poll_fd, nullptr, 0, events, 64, timeout < 0 ? nullptr : &ts);
+
+                for (int i = 0; i < n; ++i) {
+                    if (events[i].udata) {
+                        ready.push_back(static_cast<QonsoleReader*>(events[i].udata));
+                    }
+                    else {
+                        char buffer[64];
+                        ssize_t ret = ::read(m_wake_fd[0], buffer, sizeof(buffer));
+                        Q_UNUSED(ret);
+                    }
+                }
+                #elif defined(_WIN32)
+                std::vector<HANDLE> handles {m_wake_event};
+                std::vector<QonsoleReader*> owners {nullptr};
+                {
+                    QMutexLocker locker(&m_lock);
+                    for (QonsoleReader *r : m_readers) {
+                        if (std::find(m_throttled.begin(), m_throttled.end(), r) != m_throttled.end())
+                            continue;
+
+                        handles.push_back(m_events.value(r));
+                        owners.push_back(r);
+                    }
+                }
+
+                DWORD ret = WaitForMultipleObjects(
+                    static_cast<DWORD>(handles.size()), handles.data(), FALSE,
+                    timeout < 0 ? INFINITE : static_cast<DWORD>(timeout)
+                );
+
+                QMutexLocker locker(&m_lock);
+
+                if (ret > WAIT_OBJECT_0 && ret < WAIT_OBJECT_0 + handles.size()) {
+                    QonsoleReader *r = owners[ret - WAIT_OBJECT_0];
+
+                    // a reader removed during the wait may be gone already
+                    if (std::find(m_readers.begin(), m_readers.end(), r) != m_readers.end()) {
+                        WSANETWORKEVENTS ne;
+                        WSAEnumNetworkEvents(r->socket, handles[ret - WAIT_OBJECT_0], &ne);
+                        ready.push_back(r);
+                    }
+                }
+
+                // nothing waits on them anymore
+                close_retired();
+                #endif
+            }
+
+            void run() override {
+                std::vector<QonsoleReader*> ready;
+
+                while (!m_stopping) {
+                    // parked readers are resumed through wake() from consumed()
+                    wait_ready(ready, -1);
+
+                    QMutexLocker locker(&m_lock);
+
+                    for (QonsoleReader *r : ready) {
+                        // removed while we were waiting
+                        if (std::find(m_readers.begin(), m_readers.end(), r) == m_readers.end())
+                            continue;
+
+                        if (!r->can_accept()) {
+                            // park it until the consumer drains the ring, the
+                            // re-check below catches a drain that raced the flag
+                            unwatch(r);
+                            r->m_parked = true;
+                            std::atomic_thread_fence(std::memory_order_seq_cst);
+                            m_throttled.push_back(r);
+                        }
+                        else if (!r->service()) {
+                            unwatch(r);
+                            m_readers.erase(std::find(m_readers.begin(), m_readers.end(), r));
+                        }
+                    }
+
+                    // resume parked readers with room in their ring again
+                    for (auto it = m_throttled.begin(); it != m_throttled.end();) {
+                        if ((*it)->can_accept()) {
+                            (*it)->m_parked = false;
+                            watch(*it);
+                            it = m_throttled.erase(it);
+                        }
+                        else {
+                            ++it;
+                        }
+                    }
+                }
+            }
+    };
+
+    inline QonsoleReader::~QonsoleReader() {
+        if (m_multiplexer)
+            m_multiplexer->remove(this);
+    }
+
+    inline void QonsoleReader::consumed() {
+        // pairs with the fence in publish() and the parking in the multiplexer,
+        // either side sees the other's store
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (m_room_wanted.load(std::memory_order_relaxed)) {
+            QMutexLocker locker(&m_room_lock);
+            m_room.wakeAll();
+        }
+
+        if (m_parked.load(std::memory_order_relaxed) && m_multiplexer)
+            m_multiplexer->wake();
+    }
+
+    inline void QonsoleReader::start_reading() {
+        if (m_multiplexer && m_multiplexer->add(this))
+            return;
+
+        start();
+    }
+
+    // drains an outgoing queue to the reader's source on its own thread, so a
+    // peer that stops reading never blocks the caller. data is written in
+    // WRITE_CHUNK_SIZE pieces, partial writes resume where they stopped. every
+    // write waits for the source to be writable first, WRITE_STALL_WAIT at a
+    // time, so the thread never parks in write() and stop() always gets through
+    class QonsoleWriter : public QThread {
+        Q_OBJECT
+
+        QonsoleReader *m_reader;
+
+        QMutex m_lock;
+        QWaitCondition m_wake;
+        std::deque<QByteArray> m_queue;
+        size_t m_offset = 0;  // bytes of the front block already written
+        bool m_stopping = false;
+        bool m_congested = false;
+
+        std::atomic<size_t> m_queued {0};
+        std::atomic<quint64> m_stalls {0};
+        std::atomic<quint64> m_congestions {0};
+
+        public:
+            explicit QonsoleWriter(QonsoleReader *reader) : m_reader(reader) {}
+
+            ~QonsoleWriter() {
+                stop();
+            }
+
+            void enqueue(const QByteArray &data) {
+                if (data.isEmpty())
+                    return;
+
+                QMutexLocker locker(&m_lock);
+
+                m_queue.push_back(data);
+                m_queued += data.size();
+
+                bool congested = !m_congested && m_queued > WRITE_HIGH_WATERMARK;
+                if (congested) {
+                    m_congested = true;
+                    m_congestions++;
+                }
+
+                m_wake.wakeOne();
+                locker.unlock();
+
+                if (congested)
+                    emit backpressure(true);
+            }
+
+            size_t queued_bytes() const {
+                return m_queued;
+            }
+
+            // times the source did not accept more output
+            quint64 stall_count() const {
+                return m_stalls;
+            }
+
+            // times the queue crossed the high watermark
+            quint64 congestion_count() const {
+                return m_congestions;
+            }
+
+            bool is_congested() {
+                QMutexLocker locker(&m_lock);
+                return m_congested;
+            }
+
+            // drop anything not yet written
+            void clear() {
+                QMutexLocker locker(&m_lock);
+
+                // the front block may be mid-write, keep it
+                while (m_queue.size() > 1) {
+                    m_queued -= m_queue.back().size();
+                    m_queue.pop_back();
+                }
+            }
+
+            void stop() {
+                {
+                    QMutexLocker locker(&m_lock);
+                    m_stopping = true;
+                    m_wake.wakeAll();
+                }
+
+                wait();
+            }
+
+        protected:
+            void run() override {
+                while (true) {
+                    QByteArray block;
+                    size_t offset;
+
+                    {
+                        QMutexLocker locker(&m_lock);
+
+                        while (m_queue.empty() && !m_stopping)
+                            m_wake.wait(&m_lock);
+
+                        if (m_stopping)
+                            return;
+
+                        block = m_queue.front();
+                        offset = m_offset;
+                    }
+
+                    if (!m_reader->wait_writable(WRITE_STALL_WAIT)) {
+                        m_stalls++;
+                        continue;
+                    }
+
+                    size_t len = qMin<size_t>(block.size() - offset, WRITE_CHUNK_SIZE);
+                    len = qMin(len, m_reader->write_limit());
+
+                    ssize_t written = m_reader->write_source(block.constData() + offset, len);
+
+                    if (written < 0) {
+                        if (QonsoleReader::would_block()) {
+                            m_stalls++;
+                            continue;
+                        }
+
+                        qDebug() << "Error writing to source, dropping queued output.";
+                        written = block.size() - offset;
+                    }
+
+                    bool resumed = false;
+                    {
+                        QMutexLocker locker(&m_lock);
+
+                        m_offset += written;
+                        m_queued -= written;
+
+                        if (m_offset >= static_cast<size_t>(m_queue.front().size())) {
+                            m_queue.pop_front();
+                            m_offset = 0;
+                        }
+
+                        resumed = m_congested && m_queued <= WRITE_LOW_WATERMARK;
+                        if (resumed)
+                            m_congested = false;
+                    }
+
+                    if (resumed)
+                        emit backpressure(false);
+                }
+            }
+
+        signals:
+            // queued bytes crossed the high (true) or low (false) watermark
+            void backpressure(bool congested);
+    };
+
+    // parses reader output on its own thread, through a feed provided by the
+    // owner which takes care of locking the vte and its screen
+    class QonsoleParser : public QObject {
+        Q_OBJECT
+
+        QonsoleReader *m_reader;
+        std::function<void(const char*, size_t)> m_feed;
+
+        std::atomic<bool> m_notify_pending = false;
+        std::atomic<quint64> m_notifications {0};
+
+        public:
+            QonsoleParser(QonsoleReader *reader, std::function<void(const char*, size_t)> feed)
+                : m_reader(reader), m_feed(std::move(feed)) {}
+
+            // consumer side: called before presenting, so chunks parsed
+            // afterwards trigger a new parsed()
+            void acknowledge() {
+                m_notify_pending.store(false);
+            }
+
+            quint64 notification_count() const {
+                return m_notifications;
+            }
+
+            void drain() {
+                m_reader->acknowledge();
+
+                q_byte_ring &ring = m_reader->ring();
+
+                while (true) {
+                    size_t len = 0;
+                    const char *data = ring.peek(len);
+
+                    if (len == 0)
+                        break;
+
+                    // the lock is released between slices so painting can interleave
+                    len = qMin<size_t>(len, INGEST_CHUNK_SIZE);
+                    m_feed(data, len);
+                    ring.consume(len);
+                    m_reader->consumed();
+
+                    if (!m_notify_pending.exchange(true)) {
+                        m_notifications++;
+                        emit parsed();
+                    }
+                }
+            }
+
+        signals:
+            // the screen changed, emitted once until acknowledge() is called
+            void parsed();
+    };
+
+    // the terminal without a view: the vte and screen, their scrollback, and the
+    // reader, parser and writer feeding them. runs without a QApplication's
+    // widgets, QonsoleWidget attaches to one to show it
+    class QonsoleTerminal : public QObject {
+        Q_OBJECT
+
+        friend class QonsoleWidget;
+        friend class QonsoleReplay;
+
+        signals:
+            // output was parsed, views schedule a frame
+            void updated();
+
+            void resized(int cols, int lines);
+
+            // the screen was cleared by reset()
+            void screen_reset();
+
+            // the async writer's queue crossed its high (true) or low (false) watermark
+            void write_congested(bool congested);
+
+            void destructed(QonsoleReader*);
+
+        protected:
+            QonsoleReader *reader = nullptr;
+
+            // set when parsing runs on a dedicated thread
+            bool m_threaded_parsing = false;
+            QThread *m_parser_thread = nullptr;
+            QonsoleParser *m_parser = nullptr;
+
+            // outgoing data is queued to a writer thread unless disabled
+            bool m_async_write = true;
+            QonsoleWriter *m_writer = nullptr;
+
+            // without the writer, pasted data the source didn't take yet. it is
+            // written out from m_paste_timer, later writes queue behind it
+            QByteArray m_paste_queue;
+            qsizetype m_paste_offset = 0;
+            QTimer m_paste_timer;
+
+            // guards m_screen, m_vte, the scrollback and the parse counters against
+            // the parser thread
+            mutable QMutex m_tsm_lock;
+
+            int m_cols = 80;
+            int m_lines = 24;
+            int m_max_scrollback = 1000;  // Maximum lines to keep in scrollback buffer
+
+            // lines libtsm's own view is scrolled back by sb_set(), restored
+            // around keyframes
+            int m_sb_offset = 0;
+
+            // lines in libtsm's scrollback, counted from the output by history_span()
+            // as libtsm pushes them. only an upper bound once a resize or a reset
+            // from the output changed them behind the scan's back, see sb_count()
+            size_t m_sb_count = 0;
+            bool m_sb_exact = true;
+
+            // lines pushed into libtsm's scrollback so far, numbering lines from the
+            // first one ever pushed, see screen_line()
+            std::atomic<quint64> m_sb_pushed {0};
+
+            // libtsm's scrollback split in lines, extended by the lines pushed since
+            // m_sb_lines_pushed, see scrollback_lines()
+            QList<QByteArray> m_sb_lines;
+            quint64 m_sb_lines_pushed = 0;
+            bool m_sb_lines_valid = false;
+
+            // counters behind stats(), parse ones are guarded by m_tsm_lock
+            q_stats m_stats;
+            QElapsedTimer m_stats_clock;  // started on construction, stamps the snapshots
+
+            // optional trace event sink, see set_trace_file()
+            QonsoleTrace *m_trace = nullptr;
+
+            // session recording of the parsed output, see set_record_file()
+            QonsoleRecorder *m_recorder = nullptr;
+
+            // DEC private modes as last set by the output, see track_modes()
+            std::atomic<bool> m_bracketed_paste = false;   // 2004
+            std::atomic<bool> m_application_cursor = false; // 1, DECCKM
+
+            // state of a mode sequence split across chunks
+            enum { MODE_IDLE, MODE_ESC, MODE_CSI, MODE_PRIVATE };
+            int m_mode_state = MODE_IDLE;
+            int m_mode_param = 0;
+            int m_mode_mask = 0;  // 1 for DECCKM, 2 for bracketed paste among the parameters
+
+            // output held back while suspended, see set_suspended()
+            bool m_suspended = false;
+            QByteArray m_held_input;
+            QTimer m_held_timer;
+
+            // views suspending the terminal while hidden, see track_view_exposure()
+            int m_hiding_views = 0;
+            int m_exposed_views = 0;  // the exposed ones among them
+
+            // see set_resize_callback()
+            std::function<void(int, int)> m_resize_callback;
+
+            // budgeted scrollback taking over from libtsm's, see set_scrollback_budget()
+            QonsoleScrollback *m_history = nullptr;
+            size_t m_history_bound = 0;                 // lines libtsm may have scrolled off since the last migration
+            std::atomic<size_t> m_history_migrated = 0;  // lines migrated so far, views scrolled back follow it
+
+            // the scan behind history_span(): the sequence being read and the modes
+            // set by the output carry across chunks, the cursor and the modes libtsm
+            // reports are picked up from it at the start of each span
+            enum { SCAN_IDLE, SCAN_ESC, SCAN_ESC_INTERMEDIATE, SCAN_CSI, SCAN_STRING };
+
+            struct q_scan {
+                int state = SCAN_IDLE;
+                int params[2] = {0, 0};    // the first two, a third only counts
+                int param_count = 0;
+                bool prefixed = false;     // parameters after '?', '>', '<' or '='
+                bool intermediate = false; // an intermediate byte before the final
+                bool charset = false;      // ESC ( and friends, designating a charset
+
+                char32_t utf8 = 0;
+                int utf8_left = 0;
+
+                int top = 0;               // scrolling region, bottom -1 for the last line
+                int bottom = -1;
+                bool newline_mode = false; // LNM, a line feed also returns the carriage
+                bool custom_tabs = false;  // tab stops were set or cleared
+                bool hard_reset = false;   // RIS went by, libtsm's scrollback is unknown
+
+                int row = 0;
+                int column = 0;            // the width when a wrap is pending
+                bool alternate = false;
+                bool origin = false;
+                bool autowrap = true;
+            };
+
+            q_scan m_scan;
+
+            struct q_history_capture {
+                QonsoleScrollback* history;
+                size_t rows = 0;  // screen rows holding scrollback lines
+                int row = -1;     // row being captured
+            };
+
+            // tsm
+            struct tsm_screen* m_screen = nullptr;
+            struct tsm_vte* m_vte = nullptr;
+
+            static void write_callback(struct tsm_vte* vte, const char* u8, size_t len, void* data) {
+                Q_UNUSED(vte);
+                QonsoleTerminal* self = static_cast<QonsoleTerminal*>(data);
+
+                if (self) {
+                    QByteArray output(u8, static_cast<int>(len));
+                    self->write_to_source(output);
+                }
+            }
+
+            static int history_callback(
+                struct tsm_screen* screen,
+                uint64_t id,
+                const uint32_t* ch,
+                size_t len,
+                unsigned int width,
+                unsigned int posx,
+                unsigned int posy,
+                const struct tsm_screen_attr* attr,
+                tsm_age_t age,
+                void* data
+            ) {
+                Q_UNUSED(screen);
+                Q_UNUSED(id);
+                Q_UNUSED(posx);
+                Q_UNUSED(age);
+
+                q_history_capture* capture = static_cast<q_history_capture*>(data);
+
+                if (posy >= capture->rows)
+                    return 0;
+
+                // cells arrive row by row, a new row closes the previous line
+                if ((int)posy != capture->row) {
+                    if (capture->row >= 0)
+                        capture->history->end_line();
+
+                    capture->row = posy;
+                }
+
+                if (width > 0)
+                    capture->history->append_cell(ch, len, width, *attr);
+
+                return 0;
+            }
+
+            static int dump_callback(
+                struct tsm_screen *con,
+                uint64_t id,
+                const uint32_t *ch,
+                size_t len,
+                unsigned int width,
+                unsigned int posx,
+                unsigned int posy,
+                const struct tsm_screen_attr *attr,
+                tsm_age_t age,
+                void *data
+            ){
+                Q_UNUSED(con);
+                Q_UNUSED(id);
+                Q_UNUSED(attr);
+                Q_UNUSED(age);
+                
+                q_dump_grid *grid = static_cast<q_dump_grid*>(data);
+
+                if (posx >= grid->width || posy >= grid->height)
+                    return 0;
+
+                size_t index = static_cast<size_t>(posy) * grid->width + posx;
+
+                // continuation of a wide character, it owns no text
+                if (width == 0) {
+                    grid->cells[index] = 0;
+                    return 0;
+                }
+                
+                // empty cells keep their pre-filled space
+                if (len > 0 && ch != nullptr) {
+                    grid->cells[index] = ch[0];
+
+                    if (len > 1) {
+                        grid->extra.emplace_back(index, std::u32string(
+                            reinterpret_cast<const char32_t*>(ch) + 1,
+                            reinterpret_cast<const char32_t*>(ch) + len
+                        ));
+                    }
+                }
+                
+                return 0;
+            }
+
+            // lines scrolled into libtsm's scrollback by `lines` scrolling up in the
+            // region, which it caps at the region's height. the alternate screen
+            // keeps none
+            size_t scan_scroll(const q_scan &t, int lines) const {
+                int bottom = t.bottom < 0 ? m_lines - 1 : qMin(t.bottom, m_lines - 1);
+                return t.alternate ? 0 : qMin(lines, bottom - t.top + 1);
+            }
+
+            // a line feed: down a line, or scroll once the cursor reaches the
+            // bottom of the region (or of the screen below the region)
+            size_t scan_line_feed(q_scan &t) const {
+                int bottom = t.bottom < 0 ? m_lines - 1 : qMin(t.bottom, m_lines - 1);
+                int last = t.row <= bottom ? bottom : m_lines - 1;
+                size_t pushed = 0;
+
+                if (t.row >= last)
+                    pushed = scan_scroll(t, 1);
+                else
+                    t.row++;
+
+                t.column = qMin(t.column, m_cols - 1);
+                return pushed;
+            }
+
+            // a character `width` cells wide, wrapping first when a wrap is pending
+            size_t scan_print(q_scan &t, int width) const {
+                int bottom = t.bottom < 0 ? m_lines - 1 : qMin(t.bottom, m_lines - 1);
+                size_t pushed = 0;
+
+                if (t.column >= m_cols) {
+                    if (t.autowrap) {
+                        t.column = 0;
+                        t.row++;
+                    }
+                    else {
+                        t.column = m_cols - 1;
+                    }
+                }
+
+                int last = (t.row <= bottom || t.row >= m_lines) ? bottom : m_lines - 1;
+                if (t.row > last) {
+                    t.row = last;
+                    pushed = scan_scroll(t, 1);
+                }
+
+                t.column += width;
+                return pushed;
+            }
+
+            // a CSI sequence ending in `final`, false when it may move the cursor in
+            // a way the scan does not follow
+            bool scan_csi(q_scan &t, char final, size_t &pushed) const {
+                int bottom = t.bottom < 0 ? m_lines - 1 : qMin(t.bottom, m_lines - 1);
+                int n = qMax(t.params[0], 1);
+                int column = qMin(t.column, m_cols - 1);
+
+                if (t.intermediate || t.param_count > 2)
+                    return false;
+
+                if (t.prefixed) {
+                    // private modes leaving the cursor and the screen alone
+                    if (final != 'h' && final != 'l')
+                        return false;
+
+                    for (int i = 0; i < qMax(t.param_count, 1); ++i) {
+                        int mode = t.params[i];
+                        if (mode != 1 && mode != 12 && mode != 25 && mode != 2004 && (mode < 1000 || mode > 1006))
+                            return false;
+                    }
+
+                    return true;
+                }
+
+                switch (final) {
+                    case 'A': {
+                        int top = t.row >= t.top ? t.top : 0;
+                        t.row = qMax(t.row - n, top);
+                        t.column = column;
+                        return true;
+                    }
+                    case 'B': {
+                        int last = t.row <= bottom ? bottom : m_lines - 1;
+                        t.row = qMin(t.row + n, last);
+                        t.column = column;
+                        return true;
+                    }
+                    case 'C':
+                        t.column = qMin(column + n, m_cols - 1);
+                        return true;
+                    case 'D':
+                        t.column = qMax(column - n, 0);
+                        return true;
+                    case 'H':
+                    case 'f': {
+                        int row = qMax(t.params[0], 1) - 1;
+                        int col = qMax(t.params[1], 1) - 1;
+
+                        if (t.origin)
+                            row += t.top;
+
+                        t.row = qMin(row, t.origin ? bottom : m_lines - 1);
+                        t.column = qMin(col, m_cols - 1);
+                        return true;
+                    }
+                    case 'S':
+                        pushed = scan_scroll(t, n);
+                        return true;
+                    case 'r': {
+                        // libtsm homes the cursor, picked up again from it
+                        int top = qMax(t.params[0], 1);
+                        int last = t.params[1] > 0 ? t.params[1] : m_lines;
+
+                        if (last <= top || last > m_lines) {
+                            t.top = 0;
+                            t.bottom = -1;
+                        }
+                        else {
+                            t.top = top - 1;
+                            t.bottom = last - 1;
+                        }
+                        return false;
+                    }
+                    case 'h':
+                    case 'l':
+                        for (int i = 0; i < t.param_count; ++i) {
+                            if (t.params[i] == 20)
+                                t.newline_mode = final == 'h';
+                        }
+                        return true;
+                    case 'g':
+                        t.custom_tabs = true;
+                        return false;
+                    case 'T': case 'm': case 'J': case 'K': case 'X': case '@': case 'P': case 'c': case 'n':
+                        return true;
+                }
+
+                return false;
+            }
+
+            // one byte of output, false when the scan lost track of the cursor
+            bool scan_byte(q_scan &t, uchar c, size_t &pushed) const {
+                // libtsm decodes utf-8 ahead of parsing, a sequence cut short is
+                // replaced as it deems fit
+                bool followed = true;
+
+                if (t.utf8_left > 0 && (c < 0x80 || c >= 0xC0)) {
+                    t.utf8_left = 0;
+                    followed = false;
+                }
+
+                if (c < 0x80)
+                    return scan_ascii(t, c, pushed) && followed;
+
+                if (c >= 0xF8 || (c < 0xC0 && t.utf8_left == 0))
+                    return false;
+
+                if (c >= 0xC0) {
+                    t.utf8_left = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : 1;
+                    t.utf8 = c & (0x3F >> t.utf8_left);
+                    return followed;
+                }
+
+                t.utf8 = (t.utf8 << 6) | (c & 0x3F);
+                if (--t.utf8_left > 0 || t.state == SCAN_STRING)
+                    return true;
+
+                // C1 controls and characters inside a sequence
+                if (t.state != SCAN_IDLE || t.utf8 < 0xA0)
+                    return false;
+
+                int width = static_cast<int>(tsm_ucs4_get_width(t.utf8));
+                if (width > 0)
+                    pushed = scan_print(t, width);
+
+                return true;
+            }
+
+            bool scan_ascii(q_scan &t, uchar c, size_t &pushed) const {
+                if (t.state == SCAN_STRING) {
+                    if (c == '\x07' || c == '\x18' || c == '\x1a')
+                        t.state = SCAN_IDLE;
+                    else if (c == '\x1b')
+                        t.state = SCAN_ESC;
+
+                    return true;
+                }
+
+                // C0 controls act inside sequences too
+                if (c < 0x20) {
+                    switch (c) {
+                        case '\n': case '\x0b': case '\x0c':
+                            pushed = scan_line_feed(t);
+                            if (t.newline_mode)
+                                t.column = 0;
+                            return true;
+                        case '\r':
+                            t.column = 0;
+                            return true;
+                        case '\b':
+                            t.column = qMax(qMin(t.column, m_cols - 1) - 1, 0);
+                            return true;
+                        case '\t': {
+                            if (t.custom_tabs)
+                                return false;
+
+                            int stop = (qMin(t.column, m_cols - 1) / 8 + 1) * 8;
+                            t.column = qMin(stop, m_cols - 1);
+                            return true;
+                        }
+                        case '\x1b':
+                            t.state = SCAN_ESC;
+                            return true;
+                        case '\x18': case '\x1a':
+                            t.state = SCAN_IDLE;
+                            return false;
+                    }
+
+                    return true;
+                }
+
+                if (c == 0x7F)
+                    return true;
+
+                switch (t.state) {
+                    case SCAN_IDLE:
+                        pushed = scan_print(t, 1);
+                        return true;
+
+                    case SCAN_ESC:
+                        t.state = SCAN_IDLE;
+
+                        if (c == '[') {
+                            t.state = SCAN_CSI;
+                            t.params[0] = t.params[1] = 0;
+                            t.param_count = 0;
+                            t.prefixed = false;
+                            t.intermediate = false;
+                            return true;
+                        }
+
+                        if (c == ']' || c == 'P' || c == '_' || c == '^' || c == 'X') {
+                            t.state = SCAN_STRING;
+                            return true;
+                        }
+
+                        if (c < 0x30) {
+                            t.state = SCAN_ESC_INTERMEDIATE;
+                            t.charset = strchr("()*+-./", c) != nullptr;
+                            return true;
+                        }
+
+                        switch (c) {
+                            case 'D':  // IND
+                                pushed = scan_line_feed(t);
+                                return true;
+                            case 'E':  // NEL
+                                pushed = scan_line_feed(t);
+                                t.column = 0;
+                                return true;
+                            case 'M': {  // RI, scrolls down at the top
+                                int top = t.row >= t.top ? t.top : 0;
+                                t.row = qMax(t.row - 1, top);
+                                t.column = qMin(t.column, m_cols - 1);
+                                return true;
+                            }
+                            case 'H':  // HTS
+                                t.custom_tabs = true;
+                                return true;
+                            case 'c':  // RIS
+                                t = q_scan();
+                                t.hard_reset = true;
+                                return false;
+                            case '7': case '=': case '>': case '\\': case 'N': case 'O':
+                                return true;
+                        }
+
+                        return false;
+
+                    case SCAN_ESC_INTERMEDIATE:
+                        if (c < 0x30)
+                            return true;
+
+                        t.state = SCAN_IDLE;
+                        return t.charset;
+
+                    case SCAN_CSI:
+                        if (c >= '0' && c <= '9') {
+                            if (t.param_count == 0)
+                                t.param_count = 1;
+
+                            if (t.param_count <= 2) {
+                                int &param = t.params[t.param_count - 1];
+                                param = qMin(param * 10 + (c - '0'), 9999);
+                            }
+                        }
+                        else if (c == ';' || c == ':') {
+                            t.param_count = qMax(t.param_count, 1) + 1;
+                        }
+                        else if (c >= 0x3C && c <= 0x3F) {
+                            t.prefixed = true;
+                        }
+                        else if (c < 0x30) {
+                            t.intermediate = true;
+                        }
+                        else if (c >= 0x40) {
+                            t.state = SCAN_IDLE;
+                            return scan_csi(t, c, pushed);
+                        }
+
+                        return true;
+                }
+
+                return true;
+            }
+
+            // length of the longest prefix of `data` pushing at most `room` lines into
+            // libtsm's scrollback, whose lines are added to m_sb_count and, with a
+            // budgeted scrollback, to m_history_bound. the scan follows libtsm's
+            // cursor through printing, wraps, line feeds, the scrolling region and
+            // the usual cursor moves, starting from where libtsm has it. a sequence
+            // it does not follow ends the prefix, the next span picks the cursor up
+            // from libtsm again. the caller holds m_tsm_lock
+            size_t history_span(const char *data, size_t len, size_t room) {
+                q_scan scan = m_scan;
+                unsigned int flags = tsm_screen_get_flags(m_screen);
+
+                scan.row = tsm_screen_get_cursor_y(m_screen);
+                scan.column = tsm_screen_get_cursor_x(m_screen);
+                scan.alternate = flags & TSM_SCREEN_ALTERNATE;
+                scan.origin = flags & TSM_SCREEN_REL_ORIGIN;
+                scan.autowrap = flags & TSM_SCREEN_AUTO_WRAP;
+
+                size_t lines = 0;
+                size_t i = 0;
+
+                while (i < len) {
+                    q_scan next = scan;
+                    size_t pushed = 0;
+                    bool followed = scan_byte(next, static_cast<uchar>(data[i]), pushed);
+
+                    if (lines + pushed > room)
+                        break;
+
+                    scan = next;
+                    lines += pushed;
+                    ++i;
+
+                    if (!followed)
+                        break;
+                }
+
+                if (scan.hard_reset) {
+                    scan.hard_reset = false;
+                    m_sb_exact = false;
+                }
+
+                m_scan = scan;
+
+                size_t capacity = m_history ? HISTORY_CAPTURE_LINES : m_max_scrollback;
+                m_sb_count = qMin(m_sb_count + lines, capacity);
+                m_sb_pushed += lines;
+
+                if (m_history)
+                    m_history_bound += lines;
+
+                return i;
+            }
+
+            // timed tsm_vte_input(), the caller holds m_tsm_lock
+            void input(const char *data, size_t len) {
+                QElapsedTimer timer;
+                timer.start();
+                qint64 trace_start = m_trace ? m_trace->now() : 0;
+
+                tsm_vte_input(m_vte, data, len);
+
+                qint64 elapsed = timer.nsecsElapsed();
+
+                m_stats.parsed_bytes += len;
+                m_stats.parse_chunks++;
+                m_stats.parse_nsecs += elapsed;
+                m_stats.max_parse_nsecs = qMax(m_stats.max_parse_nsecs, elapsed);
+
+                if (m_trace)
+                    m_trace->complete("parse", trace_start, elapsed, "bytes", len);
+            }
+
+            // hand output to the vte, called from whichever thread parses. with a
+            // budgeted scrollback, lines are moved out of libtsm before it could
+            // have dropped any of them
+            void feed(const char *data, size_t len) {
+                QMutexLocker locker(&m_tsm_lock);
+
+                if (m_recorder)
+                    m_recorder->data(data, len);
+
+                track_modes(data, len);
+
+                // output goes in whole unless libtsm could fill up on the way, or the
+                // scan counting its scrollback has to pick up the cursor again
+                while (len > 0) {
+                    size_t room = m_history ? HISTORY_CAPTURE_LINES - m_history_bound : SIZE_MAX;
+                    size_t n = history_span(data, len, room);
+
+                    if (n == 0) {
+                        if (m_history_bound == 0) {
+                            n = 1;
+                        }
+                        else {
+                            migrate_history();
+                            continue;
+                        }
+                    }
+
+                    input(data, n);
+
+                    data += n;
+                    len -= n;
+                }
+
+                if (m_recorder && m_recorder->keyframe_due())
+                    record_keyframe();
+            }
+
+            // libtsm keeps the DEC private modes to itself, the ones input depends
+            // on are followed from the output: `ESC [ ? Pm h|l` with cursor key
+            // mode (1) or bracketed paste (2004) among the parameters, also split
+            // across chunks. the caller holds m_tsm_lock
+            void track_modes(const char *data, size_t len) {
+                const char *p = data;
+                const char *end = data + len;
+
+                while (p < end) {
+                    if (m_mode_state == MODE_IDLE) {
+                        p = static_cast<const char*>(memchr(p, '\x1b', end - p));
+                        if (!p)
+                            break;
+
+                        m_mode_state = MODE_ESC;
+                        ++p;
+                        continue;
+                    }
+
+                    char c = *p++;
+
+                    if (c == '\x1b') {
+                        m_mode_state = MODE_ESC;
+                        continue;
+                    }
+
+                    if (m_mode_state == MODE_ESC) {
+                        m_mode_state = c == '[' ? MODE_CSI : MODE_IDLE;
+                    }
+                    else if (m_mode_state == MODE_CSI) {
+                        m_mode_state = c == '?' ? MODE_PRIVATE : MODE_IDLE;
+                        m_mode_param = 0;
+                        m_mode_mask = 0;
+                    }
+                    else if (c >= '0' && c <= '9') {
+                        m_mode_param = qMin(m_mode_param * 10 + (c - '0'), 100000);
+                    }
+                    else {
+                        if (m_mode_param == 1)
+                            m_mode_mask |= 1;
+                        else if (m_mode_param == 2004)
+                            m_mode_mask |= 2;
+
+                        m_mode_param = 0;
+
+                        if (c == ';')
+                            continue;
+
+                        if (c == 'h' || c == 'l') {
+                            if (m_mode_mask & 1)
+                                m_application_cursor = c == 'h';
+                            if (m_mode_mask & 2)
+                                m_bracketed_paste = c == 'h';
+                        }
+
+                        m_mode_state = MODE_IDLE;
+                    }
+                }
+            }
+
+            // SGR sequence selecting `attr` from the default rendition
+            static QByteArray sgr(const tsm_screen_attr &attr) {
+                QByteArray out = "\x1b[0";
+
+                if (attr.bold)      out += ";1";
+                if (attr.underline) out += ";4";
+                if (attr.blink)     out += ";5";
+                if (attr.inverse)   out += ";7";
+
+                auto color = [&out](int8_t code, uint8_t r, uint8_t g, uint8_t b, int base) {
+                    if (code < 0)
+                        out += ";" + QByteArray::number(base + 8) + ";2;" + QByteArray::number(r)
+                             + ";" + QByteArray::number(g) + ";" + QByteArray::number(b);
+                    else if (code < 8)
+                        out += ";" + QByteArray::number(base + code);
+                    else if (code < 16)
+                        out += ";" + QByteArray::number(base + 60 + code - 8);
+                };
+
+                color(attr.fccode, attr.fr, attr.fg, attr.fb, 30);
+                color(attr.bccode, attr.br, attr.bg, attr.bb, 40);
+
+                out += "m";
+                return out;
+            }
+
+            struct q_keyframe_capture {
+                QByteArray out;
+                QByteArray sgr;
+                int row = -1;
+            };
+
+            static int keyframe_callback(
+                struct tsm_screen* screen,
+                uint64_t id,
+                const uint32_t* ch,
+                size_t len,
+                unsigned int width,
+                unsigned int posx,
+                unsigned int posy,
+                const struct tsm_screen_attr* attr,
+                tsm_age_t age,
+                void* data
+            ) {
+                Q_UNUSED(screen);
+                Q_UNUSED(id);
+                Q_UNUSED(age);
+
+                q_keyframe_capture* capture = static_cast<q_keyframe_capture*>(data);
+
+                // continuation of a wide character, written along with it
+                if (width == 0)
+                    return 0;
+
+                if ((int)posy != capture->row) {
+                    capture->out += "\x1b[" + QByteArray::number(posy + 1) + ";" + QByteArray::number(posx + 1) + "H";
+                    capture->row = posy;
+                }
+
+                QByteArray rendition = sgr(*attr);
+                if (rendition != capture->sgr) {
+                    capture->out += rendition;
+                    capture->sgr = rendition;
+                }
+
+                if (len == 0)
+                    capture->out.append(' ');
+
+                for (size_t i = 0; i < len; ++i)
+                    utils::append_utf8(capture->out, ch[i]);
+
+                return 0;
+            }
+
+            // output redrawing the screen as it is: the cells with their attributes
+            // and the cursor. of the terminal modes only the alternate screen and the
+            // hidden cursor are kept. the caller holds m_tsm_lock
+            QByteArray screen_keyframe() {
+                q_keyframe_capture capture;
+                unsigned int flags = tsm_screen_get_flags(m_screen);
+
+                if (flags & TSM_SCREEN_ALTERNATE)
+                    capture.out += "\x1b[?1049h";
+
+                capture.out += "\x1b[0m\x1b[H\x1b[2J";
+
+                // a libtsm view scrolled back would draw the scrollback
+                bool scrolled = m_sb_offset > 0;
+                if (scrolled)
+                    tsm_screen_sb_reset(m_screen);
+
+                tsm_screen_draw(m_screen, keyframe_callback, &capture);
+
+                if (scrolled)
+                    tsm_screen_sb_up(m_screen, m_sb_offset);
+
+                capture.out += "\x1b[0m\x1b[" + QByteArray::number(tsm_screen_get_cursor_y(m_screen) + 1)
+                             + ";" + QByteArray::number(tsm_screen_get_cursor_x(m_screen) + 1) + "H";
+
+                if (flags & TSM_SCREEN_HIDE_CURSOR)
+                    capture.out += "\x1b[?25l";
+
+                return capture.out;
+            }
+
+            // the caller holds m_tsm_lock
+            void record_keyframe() {
+                m_recorder->keyframe(tsm_screen_get_width(m_screen), tsm_screen_get_height(m_screen), screen_keyframe());
+            }
+
+            // text of libtsm's scrollback, up to `limit` lines, followed by the first
+            // screen cell. libtsm does not expose it but a selection from the oldest
+            // line down to the first screen row copies it with one line break per
+            // line. leaves the view at the bottom, the caller holds m_tsm_lock
+            QByteArray scrollback_text(unsigned int limit) {
+                tsm_screen_sb_up(m_screen, limit);
+                tsm_screen_selection_start(m_screen, 0, 0);
+                tsm_screen_sb_reset(m_screen);
+                tsm_screen_selection_target(m_screen, 0, 0);
+                m_sb_offset = 0;
+
+                char *out = nullptr;
+                int len = tsm_screen_selection_copy(m_screen, &out);
+                tsm_screen_selection_reset(m_screen);
+
+                QByteArray text;
+                if (len > 0 && out)
+                    text = QByteArray(out, len);
+
+                free(out);
+                return text;
+            }
+
+            size_t count_scrollback(unsigned int limit) {
+                QByteArray text = scrollback_text(limit);
+                return std::count(text.begin(), text.end(), '\n');
+            }
+
+            // lines in libtsm's scrollback, as counted from the output. after a
+            // resize or a reset from the output it may be more than libtsm holds,
+            // libtsm clamps a view scrolled past its oldest line. the caller holds
+            // m_tsm_lock
+            size_t sb_count() const {
+                return m_sb_count;
+            }
+
+            // libtsm's scrollback split in lines, oldest first. only the lines pushed
+            // since the last call are copied and appended, the oldest ones libtsm
+            // dropped meanwhile are trimmed. the whole of it is copied again after a
+            // resize or a reset. the caller holds m_tsm_lock
+            const QList<QByteArray>& scrollback_lines() {
+                quint64 pushed = m_sb_pushed - m_sb_lines_pushed;
+
+                if (!m_sb_lines_valid || !m_sb_exact || pushed >= m_sb_count) {
+                    m_sb_lines = scrollback_text(m_max_scrollback).split('\n');
+                    m_sb_lines.removeLast();  // first cell of the screen
+
+                    m_sb_count = m_sb_lines.size();
+                    m_sb_exact = true;
+                }
+                else if (pushed > 0) {
+                    QList<QByteArray> lines = scrollback_text(pushed).split('\n');
+                    lines.removeLast();
+                    m_sb_lines += lines;
+
+                    if ((size_t)m_sb_lines.size() > m_sb_count)
+                        m_sb_lines.remove(0, m_sb_lines.size() - m_sb_count);
+                }
+
+                m_sb_lines_valid = true;
+                m_sb_lines_pushed = m_sb_pushed;
+                return m_sb_lines;
+            }
+
+            // number of the screen's first line, counting lines from the first one
+            // ever pushed off the screen, which lets a line be told apart as the
+            // scrollback moves on. the caller holds m_tsm_lock
+            quint64 screen_line() const {
+                if (m_history)
+                    return m_history->dropped_lines() + m_history->line_count() + m_sb_count;
+
+                return m_sb_pushed;
+            }
+
+            // move libtsm's scrollback into m_history, the caller holds m_tsm_lock
+            size_t migrate_history() {
+                if (!m_history || !m_screen || m_history_bound == 0)
+                    return 0;
+
+                m_history_bound = 0;
+
+                // the scan's count, libtsm's scrollback is only copied to count it
+                // after a resize or a reset left it unsure
+                size_t count = m_sb_exact ? m_sb_count : count_scrollback(HISTORY_CAPTURE_LINES);
+
+                if (count == 0)
+                    return 0;
+
+                // walk the scrollback a screen at a time, oldest line first
+                q_history_capture capture;
+                capture.history = m_history;
+
+                unsigned int height = tsm_screen_get_height(m_screen);
+                tsm_screen_sb_up(m_screen, count);
+
+                for (size_t done = 0; done < count; ) {
+                    capture.rows = qMin<size_t>(count - done, height);
+                    capture.row = -1;
+
+                    tsm_screen_draw(m_screen, history_callback, &capture);
+
+                    if (capture.row >= 0)
+                        m_history->end_line();
+
+                    done += capture.rows;
+                    tsm_screen_sb_down(m_screen, capture.rows);
+                }
+
+                tsm_screen_clear_sb(m_screen);
+                tsm_screen_sb_reset(m_screen);
+                m_sb_offset = 0;
+                m_sb_count = 0;
+                m_sb_exact = true;
+
+                m_history_migrated += count;
+                return count;
+            }
+
+            // scroll libtsm's own view `offset` lines back from the bottom. it has a
+            // single position shared by every view, each one sets its own before
+            // drawing. libtsm ages the whole screen on a move, so views at different
+            // offsets repaint each other fully. this is only used without a history
+            // store, which draws scrolled-back lines itself and keeps libtsm at the
+            // bottom. the caller holds m_tsm_lock
+            void sb_set(int offset) {
+                offset = qMax(0, offset);
+
+                if (offset == m_sb_offset)
+                    return;
+
+                tsm_screen_sb_reset(m_screen);
+                if (offset > 0)
+                    tsm_screen_sb_up(m_screen, offset);
+
+                m_sb_offset = offset;
+            }
+
+            // drain everything the reader produced in one pass, yielding back to
+            // the event loop once the time budget is spent so input stays responsive
+            void drain_input() {
+                if (!reader || !m_vte)
+                    return;
+
+                reader->acknowledge();
+
+                q_byte_ring &ring = reader->ring();
+                QElapsedTimer budget;
+                budget.start();
+
+                while (true) {
+                    size_t len = 0;
+                    const char *data = ring.peek(len);
+
+                    if (len == 0)
+                        break;
+
+                    len = qMin<size_t>(len, INGEST_CHUNK_SIZE);
+
+                    if (m_suspended)
+                        hold_input(data, len);
+                    else
+                        feed(data, len);
+
+                    ring.consume(len);
+                    reader->consumed();
+
+                    if (budget.elapsed() >= INGEST_TIME_BUDGET) {
+                        QTimer::singleShot(0, this, &QonsoleTerminal::drain_input);
+                        break;
+                    }
+                }
+
+                if (!m_suspended)
+                    emit updated();
+            }
+
+            void on_parsed() {
+                if (m_parser)
+                    m_parser->acknowledge();
+
+                if (!m_suspended)
+                    emit updated();
+            }
+
+            // keep output of a suspended terminal for one bulk parse, done early
+            // once SUSPEND_BUFFER_SIZE is held or SUSPEND_PARSE_INTERVAL went by
+            void hold_input(const char *data, size_t len) {
+                m_held_input.append(data, len);
+
+                if (m_held_input.size() >= SUSPEND_BUFFER_SIZE)
+                    parse_held_input();
+                else if (!m_held_timer.isActive())
+                    m_held_timer.start(SUSPEND_PARSE_INTERVAL);
+            }
+
+            void parse_held_input() {
+                m_held_timer.stop();
+
+                for (qsizetype i = 0; i < m_held_input.size(); i += INGEST_CHUNK_SIZE)
+                    feed(m_held_input.constData() + i, qMin<qsizetype>(INGEST_CHUNK_SIZE, m_held_input.size() - i));
+
+                // released rather than kept around, suspended terminals are the idle ones
+                m_held_input = QByteArray();
+            }
+
+            // route reader output either to drain_input() or to the parser thread
+            void connect_reader() {
+                if (!reader)
+                    return;
+
+                disconnect(reader, &QonsoleReader::data_available, this, &QonsoleTerminal::drain_input);
+
+                if (m_parser) {
+                    connect(reader, &QonsoleReader::data_available, m_parser, &QonsoleParser::drain);
+                    // bytes may already be waiting in the ring
+                    QMetaObject::invokeMethod(m_parser, &QonsoleParser::drain, Qt::QueuedConnection);
+                }
+                else {
+                    connect(reader, &QonsoleReader::data_available, this, &QonsoleTerminal::drain_input);
+                    QMetaObject::invokeMethod(this, &QonsoleTerminal::drain_input, Qt::QueuedConnection);
+                }
+            }
+
+            // write what the source takes of the paste queue without blocking, up
+            // to PASTE_CHUNK_SIZE per step, and come back for the rest from the timer
+            void flush_paste() {
+                size_t budget = PASTE_CHUNK_SIZE;
+
+                while (reader && m_paste_offset < m_paste_queue.size() && budget > 0) {
+                    if (!reader->wait_writable(0))
+                        break;
+
+                    size_t len = qMin<size_t>(m_paste_queue.size() - m_paste_offset, budget);
+                    len = qMin(len, reader->write_limit());
+
+                    ssize_t written = reader->write_source(m_paste_queue.constData() + m_paste_offset, len);
+
+                    if (written <= 0) {
+                        if (written == 0 || QonsoleReader::would_block())
+                            break;
+
+                        qDebug() << "Error writing to source, dropping the paste.";
+                        m_paste_offset = m_paste_queue.size();
+                        break;
+                    }
+
+                    m_paste_offset += written;
+                    budget -= written;
+                }
+
+                if (!reader || m_paste_offset >= m_paste_queue.size()) {
+                    m_paste_queue = QByteArray();
+                    m_paste_offset = 0;
+                }
+                else if (!m_paste_timer.isActive()) {
+                    m_paste_timer.start(PASTE_RETRY_INTERVAL);
+                }
+            }
+
+            // hand an unfinished paste over to a writer that just started
+            void move_paste_to_writer() {
+                if (!m_writer)
+                    return;
+
+                if (m_paste_offset < m_paste_queue.size())
+                    m_writer->enqueue(m_paste_queue.mid(m_paste_offset));
+
+                m_paste_timer.stop();
+                m_paste_queue = QByteArray();
+                m_paste_offset = 0;
+            }
+
+            void start_writer() {
+                if (m_writer || !reader || !m_async_write)
+                    return;
+
+                m_writer = new QonsoleWriter(reader);
+                connect(m_writer, &QonsoleWriter::backpressure, this, &QonsoleTerminal::write_congested);
+                m_writer->start();
+            }
+
+            void stop_writer() {
+                delete m_writer;
+                m_writer = nullptr;
+            }
+
+            void start_parser_thread() {
+                if (m_parser_thread || !reader || !m_vte)
+                    return;
+
+                m_parser_thread = new QThread();
+                m_parser = new QonsoleParser(reader, [this](const char *data, size_t len) {
+                    feed(data, len);
+                });
+                m_parser->moveToThread(m_parser_thread);
+
+                connect(m_parser, &QonsoleParser::parsed, this, &QonsoleTerminal::on_parsed);
+
+                m_parser_thread->start();
+            }
+
+            void stop_parser_thread() {
+                if (!m_parser_thread)
+                    return;
+
+                m_parser_thread->quit();
+                m_parser_thread->wait();
+
+                delete m_parser;
+                delete m_parser_thread;
+
+                m_parser = nullptr;
+                m_parser_thread = nullptr;
+            }
+
+        public:
+            QonsoleTerminal(QObject *parent = nullptr) : QObject(parent) {
+                m_stats_clock.start();
+                m_held_timer.setSingleShot(true);
+                connect(&m_held_timer, &QTimer::timeout, this, &QonsoleTerminal::parse_held_input);
+
+                m_paste_timer.setSingleShot(true);
+                connect(&m_paste_timer, &QTimer::timeout, this, &QonsoleTerminal::flush_paste);
+
+                // Initialize libtsm
+                int ret = tsm_screen_new(&m_screen, nullptr, nullptr);
+                if (ret < 0) {
+                    qWarning() << "Failed to create tsm screen";
+                    m_screen = nullptr;
+                    return;
+                }
+
+                // set scrollback buffer size (IMPORTANT!)
+                tsm_screen_set_max_sb(m_screen, m_max_scrollback);
+
+                ret = tsm_vte_new(&m_vte, m_screen, write_callback, this, nullptr, nullptr);
+                if (ret < 0) {
+                    qWarning() << "Failed to create tsm vte";
+                    tsm_screen_unref(m_screen);
+                    m_screen = nullptr;
+                    m_vte = nullptr;
+                    return;
+                }
+
+                tsm_screen_resize(m_screen, m_cols, m_lines);
+            }
+
+            ~QonsoleTerminal() {
+                emit destructed(reader);
+
+                stop_parser_thread();
+                stop_writer();
+
+                delete m_history;
+                m_history = nullptr;
+
+                delete m_trace;
+                m_trace = nullptr;
+
+                delete m_recorder;
+                m_recorder = nullptr;
+
+                if (m_vte) {
+                    tsm_vte_unref(m_vte);
+                    m_vte = nullptr;
+                }
+                if (m_screen) {
+                    tsm_screen_unref(m_screen);
+                    m_screen = nullptr;
+                }
+
+                // reader not deleted, as its set from outside so user must handle that.
+            }
+
+            bool valid() const {
+                return m_vte != nullptr;
+            }
+
+            QonsoleReader* get_reader() const {
+                return reader;
+            }
+
+            // parse output that does not come from a reader
+            void on_data_ready(QByteArray data) {
+                if (!m_vte)
+                    return;
+
+                if (m_suspended) {
+                    hold_input(data.constData(), data.size());
+                    return;
+                }
+
+                feed(data.constData(), data.size());
+                emit updated();
+            }
+
+            // hold output back and parse it in bulk, without signalling views, for
+            // a terminal nobody is looking at. resuming parses what is held and
+            // signals updated() once
+            void set_suspended(bool s) {
+                if (s == m_suspended)
+                    return;
+
+                m_suspended = s;
+
+                if (!s) {
+                    parse_held_input();
+                    emit updated();
+                }
+            }
+
+            bool suspended() const {
+                return m_suspended;
+            }
+
+            // views that suspend the terminal while hidden (un)register and report
+            // their exposure here as deltas; the terminal is suspended once every
+            // registered view is hidden and resumed when the last one unregisters
+            void track_view_exposure(int views, int exposed) {
+                m_hiding_views += views;
+                m_exposed_views += exposed;
+
+                set_suspended(m_hiding_views > 0 && m_exposed_views == 0);
+            }
+
+            void resize(int cols, int lines) {
+                // held output was written for the current size
+                parse_held_input();
+
+                m_cols = qMax(cols, 1);
+                m_lines = qMax(lines, 1);
+                
+                if (m_screen) {
+                    QMutexLocker locker(&m_tsm_lock);
+                    int old_lines = tsm_screen_get_height(m_screen);
+                    tsm_screen_resize(m_screen, m_cols, m_lines);
+
+                    // shrinking pushes at most the lines cut off into the scrollback,
+                    // libtsm resets the scrolling region
+                    size_t capacity = m_history ? HISTORY_CAPTURE_LINES : m_max_scrollback;
+                    size_t cut = qMax(old_lines - m_lines, 0);
+
+                    m_sb_count = qMin(m_sb_count + cut, capacity);
+                    m_sb_pushed += cut;
+                    m_sb_exact = false;
+                    m_history_bound = m_history ? qMin<size_t>(m_history_bound + cut, HISTORY_CAPTURE_LINES) : 0;
+                    m_scan.top = 0;
+                    m_scan.bottom = -1;
+                    m_sb_lines_valid = false;
+
+                    if (m_recorder)
+                        m_recorder->resize(m_cols, m_lines);
+                }
+
+                // if connected to a local pty, notify the process about size change
+                #if defined(__linux__) || defined(__APPLE__)
+                if (reader && reader->file_descriptor >= 0) {
+                    struct winsize ws;
+                    ws.ws_col = m_cols;
+                    ws.ws_row = m_lines;
+                    ws.ws_xpixel = 0;
+                    ws.ws_ypixel = 0;
+                    ioctl(reader->file_descriptor, TIOCSWINSZ, &ws);
+                }
+                #endif
+
+                if (m_resize_callback)
+                    m_resize_callback(m_cols, m_lines);
+
+                emit resized(m_cols, m_lines);
+            }
+
+            // called with the new size on each resize, for readers a local TIOCSWINSZ
+            // does not reach: sockets, serial lines, an SSH channel's window-change
+            void set_resize_callback(std::function<void(int cols, int lines)> callback) {
+                m_resize_callback = std::move(callback);
+            }
+
+            // back to a blank `cols`x`lines` screen with no scrollback, where a
+            // replay starts from
+            void reset(int cols, int lines) {
+                if (!m_vte)
+                    return;
+
+                m_held_timer.stop();
+                m_held_input = QByteArray();
+
+                {
+                    QMutexLocker locker(&m_tsm_lock);
+
+                    tsm_vte_hard_reset(m_vte);
+                    tsm_screen_clear_sb(m_screen);
+                    tsm_screen_sb_reset(m_screen);
+                    m_sb_offset = 0;
+
+                    m_bracketed_paste = false;
+                    m_application_cursor = false;
+                    m_mode_state = MODE_IDLE;
+
+                    if (m_history)
+                        m_history->clear();
+
+                    m_history_bound = 0;
+                    m_scan = q_scan();
+                    m_sb_count = 0;
+                    m_sb_exact = true;
+                    m_sb_lines_valid = false;
+                }
+
+                resize(cols, lines);
+                emit screen_reset();
+            }
+
+            // write to source fd/handle, with async writes enabled the data is
+            // queued and the queued size is returned
+            ssize_t write_to_source(const QByteArray& data) {
+                if (!reader)
+                    return -1; // error
+
+                if (m_writer) {
+                    m_writer->enqueue(data);
+                    return data.size();
+                }
+
+                // keep the order with a paste still being written out
+                if (!m_paste_queue.isEmpty()) {
+                    m_paste_queue += data;
+                    return data.size();
+                }
+
+                return reader->write_source(data.constData(), data.size());
+            }
+
+            // send pasted text: line breaks become carriage returns in one pass,
+            // and when the program asked for bracketed paste it is wrapped in
+            // ESC[200~ / ESC[201~ with any ESC inside dropped so the paste cannot
+            // end itself early. queued to the writer as one block, without async
+            // writes it is written out from the event loop as the source takes it,
+            // so a large paste never blocks the calling thread. returns the bytes
+            // sent or queued
+            ssize_t paste(const QByteArray &text) {
+                if (!reader || text.isEmpty())
+                    return -1;
+
+                bool bracketed = m_bracketed_paste;
+
+                QByteArray out(text.size() + (bracketed ? 12 : 0), Qt::Uninitialized);
+                char *dst = out.data();
+
+                if (bracketed) {
+                    memcpy(dst, "\x1b[200~", 6);
+                    dst += 6;
+                }
+
+                const char *src = text.constData();
+                const char *end = src + text.size();
+
+                for (; src < end; ++src) {
+                    char c = *src;
+
+                    if (c == '\n') {
+                        // \r\n was already sent as \r
+                        if (src > text.constData() && src[-1] == '\r')
+                            continue;
+                        c = '\r';
+                    }
+                    else if (c == '\x1b' && bracketed) {
+                        continue;
+                    }
+
+                    *dst++ = c;
+                }
+
+                if (bracketed) {
+                    memcpy(dst, "\x1b[201~", 6);
+                    dst += 6;
+                }
+
+                out.truncate(dst - out.constData());
+
+                if (m_writer) {
+                    m_writer->enqueue(out);
+                    return out.size();
+                }
+
+                qsizetype size = out.size();
+                if (m_paste_queue.isEmpty())
+                    m_paste_queue = std::move(out);
+                else
+                    m_paste_queue += out;
+
+                flush_paste();
+                return size;
+            }
+
+            // bracketed paste requested by the program
+            bool bracketed_paste() const {
+                return m_bracketed_paste;
+            }
+
+            // application cursor keys (DECCKM) requested by the program
+            bool application_cursor_keys() const {
+                return m_application_cursor;
+            }
+
+            // bytes waiting in the async writer's queue
+            size_t pending_write_bytes() const {
+                return m_writer ? m_writer->queued_bytes() : 0;
+            }
+
+            // queue writes to a writer thread (enabled by default), when disabled
+            // write_to_source() calls write() directly on the calling thread
+            void set_async_write(bool s) {
+                m_async_write = s;
+
+                stop_writer();
+                start_writer();
+                move_paste_to_writer();
+            }
+
+            // init reader
+            void set_reader(QonsoleReader* r) {
+                this->reader = r;
+
+                // the parser and writer are bound to their reader, rebuild them for the new one
+                stop_parser_thread();
+                stop_writer();
+                start_writer();
+
+                // a paste in progress was meant for the previous source
+                m_paste_timer.stop();
+                m_paste_queue = QByteArray();
+                m_paste_offset = 0;
+
+                if (m_threaded_parsing)
+                    start_parser_thread();
+
+                connect_reader();
+
+                reader->start_reading();
+            }
+
+            // run escape-sequence parsing on a dedicated thread instead of the GUI
+            // thread, painting then only waits for the screen lock
+            void set_threaded_parsing(bool s) {
+                m_threaded_parsing = s;
+
+                stop_parser_thread();
+
+                if (s)
+                    start_parser_thread();
+
+                connect_reader();
+            }
+
+            void set_max_scrollback(unsigned int lines) {
+                m_max_scrollback = lines;
+                
+                // libtsm only stages lines for the budgeted scrollback
+                if (m_screen && !m_history) {
+                    // Tell libtsm to limit the scrollback buffer size
+                    QMutexLocker locker(&m_tsm_lock);
+                    tsm_screen_set_max_sb(m_screen, m_max_scrollback);
+                    m_sb_count = qMin<size_t>(m_sb_count, m_max_scrollback);
+                    m_sb_lines_valid = false;
+                }
+            }
+
+            // keep scrollback in a store bounded by `bytes` instead of libtsm's line
+            // limit, full blocks of lines are zlib compressed when `compress` is set.
+            // 0 goes back to libtsm's scrollback of set_max_scrollback() lines
+            void set_scrollback_budget(size_t bytes, bool compress = true) {
+                if (!m_screen)
+                    return;
+
+                QMutexLocker locker(&m_tsm_lock);
+
+                if (bytes == 0) {
+                    delete m_history;
+                    m_history = nullptr;
+
+                    tsm_screen_set_max_sb(m_screen, m_max_scrollback);
+                    m_sb_count = qMin<size_t>(m_sb_count, m_max_scrollback);
+                }
+                else if (m_history) {
+                    m_history->set_budget(bytes);
+                }
+                else {
+                    m_history = new QonsoleScrollback(bytes, compress);
+
+                    // whatever libtsm holds already is moved over right away
+                    tsm_screen_sb_reset(m_screen);
+                    tsm_screen_set_max_sb(m_screen, HISTORY_CAPTURE_LINES);
+
+                    m_history_bound = HISTORY_CAPTURE_LINES;
+                    migrate_history();
+                }
+
+                m_sb_offset = 0;
+                m_sb_lines_valid = false;
+            }
+
+            // spill the budgeted scrollback to a memory-mapped file in `dir` rather
+            // than dropping lines over the budget, see set_scrollback_budget()
+            void set_scrollback_spill(bool enable, const QString &dir = QString(), size_t disk_budget = 0) {
+                QMutexLocker locker(&m_tsm_lock);
+
+                if (!m_history) {
+                    qWarning() << "Scrollback spill needs a scrollback budget.";
+                    return;
+                }
+
+                m_history->set_spill(enable, dir, disk_budget);
+            }
+
+            // bytes of the budgeted scrollback spilled to disk
+            size_t get_scrollback_disk_usage() const {
+                QMutexLocker locker(&m_tsm_lock);
+                return m_history ? m_history->disk_usage() : 0;
+            }
+
+            // bytes held by the budgeted scrollback
+            size_t get_scrollback_memory() const {
+                QMutexLocker locker(&m_tsm_lock);
+                return m_history ? m_history->memory_usage() : 0;
+            }
+
+            void get_terminal_size(int& cols, int& lines) {
+                cols = m_cols;
+                lines = m_lines;
+            }
+
+            QString dump_screen() {
+                q_dump_grid grid;
+                dump_grid(grid);
+
+                std::u32string text = grid_text(grid, 0, 0, grid.height - 1, grid.width - 1);
+                return QString::fromUcs4(text.data(), text.size());
+            }
+
+            // same as dump_screen(), encoded straight to UTF-8
+            QByteArray dump_screen_utf8() {
+                q_dump_grid grid;
+                dump_grid(grid);
+
+                return utils::to_utf8(grid_text(grid, 0, 0, grid.height - 1, grid.width - 1));
+            }
+
+            // fill grid with the visible screen
+            void dump_grid(q_dump_grid &grid) {
+                grid = q_dump_grid();
+
+                if (!m_screen)
+                    return;
+
+                parse_held_input();
+
+                QMutexLocker locker(&m_tsm_lock);
+
+                grid.width = tsm_screen_get_width(m_screen);
+                grid.height = tsm_screen_get_height(m_screen);
+                grid.cells.assign(static_cast<size_t>(grid.width) * grid.height, U' ');
+
+                tsm_screen_draw(m_screen, dump_callback, &grid);
+            }
+
+            // text of the cells from (sl, sc) to (el, ec) inclusive, rows joined by newlines
+            static std::u32string grid_text(const q_dump_grid &grid, uint sl, uint sc, uint el, uint ec) {
+                std::u32string out;
+
+                if (grid.width == 0 || grid.height == 0)
+                    return out;
+
+                el = qMin(el, grid.height - 1);
+                out.reserve(static_cast<size_t>(el - sl + 1) * (grid.width + 1));
+
+                auto extra = grid.extra.begin();
+
+                for (uint line = sl; line <= el; ++line) {
+                    uint c_start = (line == sl) ? sc : 0;
+                    uint c_end   = (line == el) ? qMin(ec, grid.width - 1) : grid.width - 1;
+
+                    if (c_start > c_end)
+                        continue;
+
+                    size_t index = static_cast<size_t>(line) * grid.width + c_start;
+                    size_t end = static_cast<size_t>(line) * grid.width + c_end;
+
+                    while (extra != grid.extra.end() && extra->first < index)
+                        ++extra;
+
+                    for (; index <= end; ++index) {
+                        if (grid.cells[index] == 0)
+                            continue;
+
+                        out += grid.cells[index];
+
+                        while (extra != grid.extra.end() && extra->first == index) {
+                            out += extra->second;
+                            ++extra;
+                        }
+                    }
+
+                    if (line != el)
+                        out += U'\n';
+                }
+
+                return out;
+            }
+
+            // snapshot of the runtime counters of the reader, the parser and the
+            // writer. taking one changes nothing, any number of callers can sample
+            q_stats stats() const {
+                QMutexLocker locker(&m_tsm_lock);
+                q_stats s = m_stats;
+                locker.unlock();
+
+                s.msecs = m_stats_clock.elapsed();
+                s.backlog_bytes = m_held_input.size();
+
+                if (reader) {
+                    s.reader = reader->stats();
+                    s.backlog_bytes += s.reader.queued_bytes;
+                }
+
+                if (m_parser)
+                    s.parsed_notifications = m_parser->notification_count();
+
+                if (m_writer) {
+                    s.write_queue_bytes = m_writer->queued_bytes();
+                    s.write_stalls = m_writer->stall_count();
+                    s.write_congestions = m_writer->congestion_count();
+                }
+
+                return s;
+            }
+
+            // write parse and paint spans to `path` as Chrome trace events, which
+            // Perfetto loads. an empty path stops tracing
+            bool set_trace_file(const QString &path) {
+                QonsoleTrace *trace = nullptr;
+
+                if (!path.isEmpty()) {
+                    trace = new QonsoleTrace();
+
+                    if (!trace->open(path)) {
+                        qWarning() << "Failed to open trace file" << path;
+                        delete trace;
+                        return false;
+                    }
+                }
+
+                QMutexLocker locker(&m_tsm_lock);
+                std::swap(trace, m_trace);
+                locker.unlock();
+
+                delete trace;
+                return true;
+            }
+
+            // record the output to `path` as it is parsed, see QonsoleReplay to play
+            // it back. the recording starts with a keyframe of the current screen.
+            // an empty path stops recording
+            bool set_record_file(const QString &path) {
+                QonsoleRecorder *recorder = nullptr;
+
+                if (!path.isEmpty()) {
+                    recorder = new QonsoleRecorder();
+
+                    if (!m_screen || !recorder->open(path, m_cols, m_lines)) {
+                        qWarning() << "Failed to open recording file" << path;
+                        delete recorder;
+                        return false;
+                    }
+                }
+
+                QMutexLocker locker(&m_tsm_lock);
+                std::swap(recorder, m_recorder);
+
+                if (m_recorder)
+                    record_keyframe();
+
+                locker.unlock();
+
+                delete recorder;
+                return true;
+            }
+    };
+
+    #ifdef QONSOLE_OPENGL
+    class QonsoleWidget;
+
+    // one instance per drawn cell, see QonsoleGLRenderer
+    struct q_gl_cell {
+        uint16_t col;
+        uint16_t row;
+        uint32_t glyph;  // atlas slot, 0 is blank
+        uint32_t flags;  // GL_CELL_* bits
+        uint32_t fg;     // RGBA bytes
+        uint32_t bg;
+    };
+
+    enum q_gl_cell_flag : uint32_t {
+        GL_CELL_WIDE = 1,
+        GL_CELL_UNDERLINE = 2,
+        GL_CELL_CURSOR_IBEAM = 4,
+        GL_CELL_CURSOR_UNDERLINE = 8
+    };
+
+    // OpenGL backend of QonsoleWidget, laid over it. cells are uploaded as an
+    // instance buffer indexing a glyph atlas, the whole view is one instanced draw
+    class QonsoleGLRenderer : public QOpenGLWidget, protected QOpenGLExtraFunctions {
+        Q_OBJECT
+
+        QonsoleWidget *m_owner;
+
+        QOpenGLShaderProgram *m_program = nullptr;
+        GLuint m_vao = 0;
+        GLuint m_vbo = 0;
+        GLuint m_atlas = 0;
+
+        // glyphs rasterized as coverage, in slots of one cell, wide glyphs take two.
+        // single codepoints are keyed like cached_glyph(), clusters by their text
+        QImage m_atlas_image;
+        QHash<quint64, quint32> m_slots;
+        QHash<QString, quint32> m_cluster_slots;
+        quint32 m_next_slot = 1;
+        int m_slot_width = 0;
+        int m_slot_height = 0;
+        int m_per_row = 0;
+        bool m_atlas_dirty = true;
+        bool m_atlas_full = false;
+
+        std::vector<q_gl_cell> m_cells;
+
+        static const char* vertex_source() {
+            return
+                "in uvec2 a_cell;\n"
+                "in uint a_glyph;\n"
+                "in uint a_flags;\n"
+                "in vec4 a_fg;\n"
+                "in vec4 a_bg;\n"
+                "uniform vec2 u_cell;\n"
+                "uniform vec2 u_viewport;\n"
+                "uniform vec2 u_slot;\n"
+                "uniform float u_per_row;\n"
+                "out vec2 v_uv;\n"
+                "out vec2 v_local;\n"
+                "flat out vec4 v_fg;\n"
+                "flat out vec4 v_bg;\n"
+                "flat out uint v_flags;\n"
+                "const vec2 corners[6] = vec2[6](vec2(0.0, 0.0), vec2(1.0, 0.0), vec2(0.0, 1.0),\n"
+                "                                vec2(0.0, 1.0), vec2(1.0, 0.0), vec2(1.0, 1.0));\n"
+                "void main() {\n"
+                "    vec2 corner = corners[gl_VertexID];\n"
+                "    vec2 span = vec2((a_flags & 1u) != 0u ? 2.0 : 1.0, 1.0);\n"
+                "    vec2 pos = vec2(a_cell) * u_cell + corner * span * u_cell;\n"
+                "    gl_Position = vec4(pos.x / u_viewport.x * 2.0 - 1.0, 1.0 - pos.y / u_viewport.y * 2.0, 0.0, 1.0);\n"
+                "    float glyph = float(a_glyph);\n"
+                "    vec2 slot = vec2(mod(glyph, u_per_row), floor(glyph / u_per_row));\n"
+                "    v_uv = (slot + corner * span) * u_slot;\n"
+                "    v_local = corner * span * u_cell;\n"
+                "    v_fg = a_fg;\n"
+                "    v_bg = a_bg;\n"
+                "    v_flags = a_flags;\n"
+                "}\n";
+        }
+
+        static const char* fragment_source() {
+            return
+                "in vec2 v_uv;\n"
+                "in vec2 v_local;\n"
+                "flat in vec4 v_fg;\n"
+                "flat in vec4 v_bg;\n"
+                "flat in uint v_flags;\n"
+                "uniform sampler2D u_atlas;\n"
+                "uniform vec2 u_cell;\n"
+                "out vec4 frag;\n"
+                "void main() {\n"
+                "    vec4 color = mix(v_bg, v_fg, texture(u_atlas, v_uv).r);\n"
+                "    float line = max(1.0, floor(u_cell.y / 12.0));\n"
+                "    if ((v_flags & 2u) != 0u && v_local.y >= u_cell.y - 2.0 * line && v_local.y < u_cell.y - line)\n"
+                "        color = v_fg;\n"
+                "    if ((v_flags & 4u) != 0u && abs(v_local.x - u_cell.x / 2.0) <= line)\n"
+                "        color = v_fg;\n"
+                "    if ((v_flags & 8u) != 0u && v_local.y >= u_cell.y - 2.0 * line)\n"
+                "        color = v_fg;\n"
+                "    frag = color;\n"
+                "}\n";
+        }
+
+        // QRgb is 0xAARRGGBB, the shader reads bytes as r, g, b, a
+        static uint32_t pack(QRgb c) {
+            return static_cast<uint32_t>(qRed(c))
+                 | static_cast<uint32_t>(qGreen(c)) << 8
+                 | static_cast<uint32_t>(qBlue(c)) << 16
+                 | static_cast<uint32_t>(qAlpha(c)) << 24;
+        }
+
+        public:
+            explicit QonsoleGLRenderer(QonsoleWidget *owner);
+
+            ~QonsoleGLRenderer() {
+                makeCurrent();
+
+                delete m_program;
+                if (m_vbo)
+                    glDeleteBuffers(1, &m_vbo);
+                if (m_vao)
+                    glDeleteVertexArrays(1, &m_vao);
+                if (m_atlas)
+                    glDeleteTextures(1, &m_atlas);
+
+                doneCurrent();
+            }
+
+            // drop every glyph, for font or pixel ratio changes
+            void reset_atlas(int cell_width, int cell_height) {
+                qreal dpr = devicePixelRatioF();
+
+                m_slot_width = qMax(1, qRound(cell_width * dpr));
+                m_slot_height = qMax(1, qRound(cell_height * dpr));
+                m_per_row = qMax(2, GL_ATLAS_SIZE / m_slot_width);
+
+                m_atlas_image = QImage(m_per_row * m_slot_width, GL_ATLAS_SIZE, QImage::Format_Alpha8);
+                m_atlas_image.fill(0);
+
+                m_slots.clear();
+                m_cluster_slots.clear();
+                m_next_slot = 1;
+                m_atlas_dirty = true;
+                m_atlas_full = false;
+            }
+
+            // atlas slot of a cell's text, rasterized on first use. the common
+            // single-codepoint cell is looked up without building a string
+            quint32 glyph_slot(const QFont &font, int variant, const uint32_t *ch, size_t len, unsigned int width, int baseline) {
+                quint32 span = width > 1 ? 2 : 1;
+
+                if (len == 1) {
+                    quint64 key = static_cast<quint64>(ch[0] & 0x1FFFFF)
+                        | static_cast<quint64>(variant & 0xFF) << 21
+                        | static_cast<quint64>(span) << 29;
+
+                    auto it = m_slots.constFind(key);
+                    if (it != m_slots.constEnd())
+                        return *it;
+
+                    quint32 slot = rasterize(font, QString::fromUcs4(reinterpret_cast<const char32_t*>(ch), 1), span, baseline);
+                    return slot ? *m_slots.insert(key, slot) : 0;
+                }
+
+                QString text = QString::fromUcs4(reinterpret_cast<const char32_t*>(ch), len);
+                QString key = QString(QChar('0' + variant)) + QString(QChar(span > 1 ? '2' : '1')) + text;
+
+                auto it = m_cluster_slots.constFind(key);
+                if (it != m_cluster_slots.constEnd())
+                    return *it;
+
+                quint32 slot = rasterize(font, text, span, baseline);
+                return slot ? *m_cluster_slots.insert(key, slot) : 0;
+            }
+
+            // draw `text` into the next free slot(s), 0 once the atlas is full
+            quint32 rasterize(const QFont &font, const QString &text, quint32 span, int baseline) {
+                // wide glyphs keep both slots on the same atlas row
+                quint32 slot = m_next_slot;
+                if (span == 2 && slot % m_per_row == static_cast<quint32>(m_per_row) - 1)
+                    slot++;
+
+                if ((slot + span - 1) / m_per_row >= static_cast<quint32>(GL_ATLAS_SIZE / m_slot_height)) {
+                    m_atlas_full = true;
+                    return 0;
+                }
+
+                m_next_slot = slot + span;
+
+                int x = (slot % m_per_row) * m_slot_width;
+                int y = (slot / m_per_row) * m_slot_height;
+
+                QPainter painter(&m_atlas_image);
+                painter.setClipRect(x, y, m_slot_width * static_cast<int>(span), m_slot_height);
+                painter.scale(devicePixelRatioF(), devicePixelRatioF());
+                painter.setFont(font);
+                painter.setPen(Qt::white);
+                painter.drawText(QPointF(x / devicePixelRatioF(), y / devicePixelRatioF() + baseline), text);
+                painter.end();
+
+                m_atlas_dirty = true;
+                return slot;
+            }
+
+            // start over when the cell size in device pixels changed
+            void ensure_atlas(int cell_width, int cell_height) {
+                qreal dpr = devicePixelRatioF();
+
+                if (m_atlas_image.isNull()
+                    || qMax(1, qRound(cell_width * dpr)) != m_slot_width
+                    || qMax(1, qRound(cell_height * dpr)) != m_slot_height) {
+                    reset_atlas(cell_width, cell_height);
+                }
+            }
+
+            void clear_cells() {
+                m_cells.clear();
+            }
+
+            void push_cell(unsigned int col, unsigned int row, quint32 glyph, uint32_t flags, QRgb fg, QRgb bg) {
+                m_cells.push_back({
+                    static_cast<uint16_t>(col), static_cast<uint16_t>(row),
+                    glyph, flags, pack(fg), pack(bg)
+                });
+            }
+
+        protected:
+            void initializeGL() override {
+                initializeOpenGLFunctions();
+
+                // GLSL 3.30 core on desktop, 3.00 es on GLES
+                QByteArray header = context()->isOpenGLES()
+                    ? "#version 300 es\nprecision highp float;\nprecision highp int;\n"
+                    : "#version 330 core\n";
+
+                m_program = new QOpenGLShaderProgram();
+                m_program->addShaderFromSourceCode(QOpenGLShader::Vertex, header + vertex_source());
+                m_program->addShaderFromSourceCode(QOpenGLShader::Fragment, header + fragment_source());
+
+                if (!m_program->link())
+                    qWarning() << "Failed to link the terminal shader:" << m_program->log();
+
+                glGenVertexArrays(1, &m_vao);
+                glGenBuffers(1, &m_vbo);
+                glGenTextures(1, &m_atlas);
+
+                glBindVertexArray(m_vao);
+                glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+
+                GLuint cell = m_program->attributeLocation("a_cell");
+                GLuint glyph = m_program->attributeLocation("a_glyph");
+                GLuint flags = m_program->attributeLocation("a_flags");
+                GLuint fg = m_program->attributeLocation("a_fg");
+                GLuint bg = m_program->attributeLocation("a_bg");
+
+                glEnableVertexAttribArray(cell);
+                glVertexAttribIPointer(cell, 2, GL_UNSIGNED_SHORT, sizeof(q_gl_cell), reinterpret_cast<void*>(offsetof(q_gl_cell, col)));
+                glEnableVertexAttribArray(glyph);
+                glVertexAttribIPointer(glyph, 1, GL_UNSIGNED_INT, sizeof(q_gl_cell), reinterpret_cast<void*>(offsetof(q_gl_cell, glyph)));
+                glEnableVertexAttribArray(flags);
+                glVertexAttribIPointer(flags, 1, GL_UNSIGNED_INT, sizeof(q_gl_cell), reinterpret_cast<void*>(offsetof(q_gl_cell, flags)));
+                glEnableVertexAttribArray(fg);
+                glVertexAttribPointer(fg, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(q_gl_cell), reinterpret_cast<void*>(offsetof(q_gl_cell, fg)));
+                glEnableVertexAttribArray(bg);
+                glVertexAttribPointer(bg, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(q_gl_cell), reinterpret_cast<void*>(offsetof(q_gl_cell, bg)));
+
+                for (GLuint attribute : {cell, glyph, flags, fg, bg})
+                    glVertexAttribDivisor(attribute, 1);
+
+                glBindVertexArray(0);
+
+                glBindTexture(GL_TEXTURE_2D, m_atlas);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+                m_atlas_dirty = true;
+            }
+
+            void paintGL() override;
+    };
+    #endif // QONSOLE_OPENGL
+
+    class QonsoleWidget : public QWidget {
+        Q_OBJECT
+
+        #ifdef QONSOLE_OPENGL
+        friend class QonsoleGLRenderer;
+        #endif
+        friend class QonsoleReplay;
+
+        signals:
+            void destructed(QonsoleReader*);
+            void closed(QonsoleReader*);
+
+            // the async writer's queue crossed its high (true) or low (false) watermark
+            void write_congested(bool congested);
+
+        protected:
+            // the terminal shown, owned unless it was attached by the constructor
+            QonsoleTerminal *m_term = nullptr;
+            bool m_owns_terminal = false;
+
+            QFont m_font;
+
+            // the font as drawn, one face per variant, built by update_metrics()
+            enum { FONT_REGULAR = 0, FONT_BOLD = 1, FONT_VARIANTS = 2 };
+
+            struct q_font_face {
+                QFont font;
+                int underline_pos = 0;  // pixels below the baseline
+                int line_width = 1;
+            };
+            q_font_face m_faces[FONT_VARIANTS];
+            int m_char_width;
+            int m_char_height;
+            bool m_use_bold = false;
+            bool m_is_selecting = false;  // inner state
+            bool m_draw_empty_cells = false;
+            bool m_incremental_repaint = true;
+            bool m_use_glyph_cache = true;
+
+            // paint counters behind stats(), the rest is the terminal's
+            q_stats m_stats;
+
+            #ifdef QONSOLE_OPENGL
+            // set while the OpenGL backend draws in place of paintEvent()
+            QonsoleGLRenderer *m_gl = nullptr;
+            #endif
+            bool __m_requesting_dump = false;
+            int m_scroll_offset = 0;  // Current scroll position (0 = bottom/latest output)
+            int m_scroll_pixels = 0;  // view pushed further down by part of a line, [0, m_char_height)
+            size_t m_history_seen = 0;  // m_term->m_history_migrated when the view last followed it
+
+            QColor m_default_fg;
+            QColor m_default_bg;
+            QColor m_selection_bg;
+            QColor m_palette[16];
+
+            // libtsm's color codes after the 16 palette entries
+            enum { COLOR_FOREGROUND = 16, COLOR_BACKGROUND = 17, COLOR_CODES = 18 };
+
+            // packed colors indexed by libtsm's color codes, see build_color_table()
+            QRgb m_color_table[COLOR_CODES] = {};
+            QRgb m_packed_selection = 0;
+
+            // repaints are capped at the display refresh rate, frames are driven by
+            // the window's update requests (vsync where the platform has it) with
+            // m_frame_timer as a fallback
+            q_frame_pacing m_pacing = THROUGHPUT;
+            QTimer m_frame_timer;
+            QElapsedTimer m_frame_clock;
+            QElapsedTimer m_key_clock;
+            QPointer<QWindow> m_paced_window;
+            bool m_frame_requested = false;
+            bool m_frame_skipped = false;  // output arrived while hidden or minimized
+
+            // smooth scrolling: wheel notches ease in, trackpad flings coast to a stop
+            QTimer m_scroll_timer;
+            QElapsedTimer m_scroll_clock;
+            double m_scroll_pending = 0;   // pixels of wheel notches still to ease in
+            double m_scroll_velocity = 0;  // pixels per second of a fling
+            double m_scroll_fraction = 0;  // fraction of a pixel carried to the next step
+
+            // key translation, see set_cursor_keys() and bind_key()
+            q_cursor_keys m_cursor_keys = CURSOR_KEYS_AUTO;
+            QHash<quint64, QByteArray> m_key_bindings;
+            bool m_legacy_keys = false;
+
+            // see set_suspend_when_hidden(), m_counted_* mirror what this view
+            // reported to QonsoleTerminal::track_view_exposure()
+            bool m_suspend_hidden = false;
+            bool m_drop_caches_hidden = false;
+            bool m_counted_view = false;
+            bool m_counted_exposed = false;
+
+            // see set_resize_mode(), a debounced size waits in m_resize_pending
+            // until m_resize_timer fires
+            q_resize_mode m_resize_mode = RESIZE_IMMEDIATE;
+            QTimer m_resize_timer;
+            QSize m_resize_pending;  // columns x lines
+            QImage m_resize_frame;   // the frame scaled meanwhile with RESIZE_STRETCH
+
+            // screen age returned by the last damage scan, 0 forces a full repaint
+            tsm_age_t m_last_age = 0;
+
+            // hash of what each row last had painted in full, 0 when unknown. output
+            // scrolling the screen is found by matching these against the new rows
+            std::vector<quint64> m_row_hashes;
+
+            // see set_backing_store(): cells rendered once into m_backing, m_backing_dirty
+            // holds what has to be rendered again before it is presented
+            bool m_use_backing = false;
+            QImage m_backing;
+            QRegion m_backing_dirty;
+
+            // pre-rendered glyphs keyed on (codepoint, width, font variant, fg)
+            QHash<quint64, QPixmap> m_glyph_cache;
+            qreal m_glyph_dpr = 1.0;
+
+            // consecutive cells of a row sharing the same resolved attributes
+            struct q_run {
+                int row = -1;
+                int first = 0;           // first column
+                int cells = 0;           // number of cells, each `width` columns wide
+                unsigned int width = 1;
+
+                QRgb fg = 0;
+                QRgb bg = 0;
+                int font = FONT_REGULAR;
+                bool underline = false;
+
+                bool simple = true;      // every cell holds exactly one codepoint
+                std::u32string text;
+            };
+
+            struct q_draw_context {
+                QPainter* painter;
+                QonsoleWidget* widget;
+                q_run run;
+                int painter_font = FONT_REGULAR;  // variant the painter currently holds
+
+                // per-row [first, last] column span covered by the paint region,
+                // rows not touched by the region have first > last
+                std::vector<std::pair<int, int>> rows;
+
+                // widget rows above the screen, taken by scrollback lines
+                unsigned int row_shift = 0;
+
+                // lines the drawn view is scrolled back by
+                int offset = 0;
+
+                // per-row content hashes of the screen rows, when they are recorded
+                std::vector<quint64> hashes;
+
+                // the selection applies, not to the partial line above a mid-line view
+                bool selectable = true;
+
+                quint64 cells_drawn = 0;
+                quint64 cells_skipped = 0;
+            };
+
+            #ifdef QONSOLE_OPENGL
+            struct q_gl_context {
+                QonsoleWidget* widget;
+                QonsoleGLRenderer* gl;
+                unsigned int row_shift = 0;
+            };
+            #endif
+
+            struct q_damage_context {
+                QonsoleWidget* widget;
+                tsm_age_t since;
+
+                // per-row [first, last] span of cells changed since `since`, and
+                // the hash of each row's content, see cell_hash()
+                std::vector<std::pair<int, int>> rows;
+                std::vector<quint64> hashes;
+            };
+
+            q_cursor_style m_qcstyle = q_cursor_style::BLOCK;
+            q_cursor_pos m_cursor_pos {0, 0};
+            q_selection m_selection {0, 2, 0, 9, true};
+
+            // per-row [first, last] selected columns, first > last when none
+            std::vector<std::pair<int, int>> m_selection_span;
+
+            // where find_next() continues from, highlighted until clear_search()
+            q_search_match m_last_match;
+            bool m_match_shown = false;
+            QColor m_match_bg;
+            QRgb m_packed_match = 0;
+
+            void closeEvent(QCloseEvent *event) {
+                emit closed(m_term->reader);
+            }
+
+            void paintEvent(QPaintEvent *event) override {
+                #ifdef QONSOLE_OPENGL
+                if (m_gl) {
+                    m_gl->update();
+                    return;
+                }
+                #endif
+
+                if (!m_resize_frame.isNull()) {
+                    present_resize_frame();
+                    return;
+                }
+
+                if (m_use_backing) {
+                    present_backing(event->rect());
+                    return;
+                }
+
+                QPainter painter(this);
+                render_cells(painter, event->region(), true);
+            }
+
+            // bring the backing image up to date, then present the exposed rect of it
+            // with the cursor and selection drawn on top
+            void present_backing(const QRect &exposed) {
+                qreal dpr = devicePixelRatioF();
+                QSize size(qRound(width() * dpr), qRound(height() * dpr));
+
+                if (m_backing.size() != size || m_backing.devicePixelRatio() != dpr) {
+                    m_backing = QImage(size, QImage::Format_ARGB32_Premultiplied);
+                    m_backing.setDevicePixelRatio(dpr);
+                    m_backing_dirty = rect();
+                    m_row_hashes.clear();
+                }
+
+                QRegion dirty = m_backing_dirty.intersected(rect());
+                m_backing_dirty = QRegion();
+
+                if (!dirty.isEmpty()) {
+                    QPainter backing(&m_backing);
+                    backing.setClipRegion(dirty);
+                    render_cells(backing, dirty, false);
+                }
+
+                QPainter painter(this);
+                painter.setCompositionMode(QPainter::CompositionMode_Source);
+                painter.drawImage(
+                    QRectF(exposed), m_backing,
+                    QRectF(exposed.x() * dpr, exposed.y() * dpr, exposed.width() * dpr, exposed.height() * dpr)
+                );
+                painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+
+                if (m_term->m_screen)
+                    draw_overlay(painter);
+            }
+
+            // the frame captured when a debounced resize started, scaled to the grid
+            // it is waiting for
+            void present_resize_frame() {
+                QPainter painter(this);
+                painter.fillRect(rect(), m_default_bg);
+                painter.setRenderHint(QPainter::SmoothPixmapTransform);
+                painter.drawImage(
+                    QRectF(0, 0, m_resize_pending.width() * m_char_width, m_resize_pending.height() * m_char_height),
+                    m_resize_frame, QRectF(m_resize_frame.rect())
+                );
+            }
+
+            // the selection tint and the cursor over the presented backing image
+            void draw_overlay(QPainter &painter) {
+                if (m_is_selecting) {
+                    for (size_t line = 0; line < m_selection_span.size(); ++line) {
+                        const std::pair<int, int> &span = m_selection_span[line];
+
+                        if (span.first > span.second)
+                            continue;
+
+                        painter.fillRect(
+                            span.first * m_char_width, line * m_char_height + m_scroll_pixels,
+                            (span.second - span.first + 1) * m_char_width, m_char_height,
+                            m_selection_bg
+                        );
+                    }
+                }
+
+                if (scrolled_back())
+                    return;
+
+                // a block inverts what it covers so the glyph under it stays readable
+                if (m_qcstyle == q_cursor_style::BLOCK)
+                    painter.setCompositionMode(QPainter::CompositionMode_Difference);
+
+                draw_cursor(painter);
+                painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+            }
+
+            // paint the cells touching `region`, with the cursor and the selection
+            // when `overlay` is set, into the widget or the backing image
+            void render_cells(QPainter &painter, const QRegion &region, bool overlay) {
+                QElapsedTimer timer;
+                timer.start();
+                qint64 trace_start = m_term->m_trace ? m_term->m_trace->now() : 0;
+
+                // glyphs are rasterized at the device pixel ratio, moving to another
+                // screen invalidates them
+                if (devicePixelRatioF() != m_glyph_dpr) {
+                    m_glyph_dpr = devicePixelRatioF();
+                    m_glyph_cache.clear();
+                }
+
+                draw_screen(painter);
+                
+                if (!m_term->m_screen)
+                    return;
+                
+                // only draw cursor if we're at the bottom (not scrolled back)
+                if (overlay && !scrolled_back()) {
+                    draw_cursor(painter);
+                }
+                
+                painter.setFont(m_faces[FONT_REGULAR].font);
+                
+                q_draw_context ctx;
+                ctx.painter = &painter;
+                ctx.widget = this;
+                ctx.rows.assign(m_term->m_lines, {m_term->m_cols, -1});
+                ctx.selectable = overlay;
+
+                // a view scrolled mid-line shows the bottom of the line above it
+                // in the top m_scroll_pixels
+                q_draw_context top;
+                top.painter = &painter;
+                top.widget = this;
+                top.rows.assign(m_term->m_lines, {m_term->m_cols, -1});
+                top.selectable = false;
+
+                // only cells touching the exposed region are painted, the rest
+                // is still valid in the backing store
+                for (const QRect &r : region) {
+                    int first_col = qMax(0, r.left() / m_char_width);
+                    int last_col = qMin(m_term->m_cols - 1, r.right() / m_char_width);
+
+                    if (r.top() < m_scroll_pixels) {
+                        top.rows[0].first = qMin(top.rows[0].first, first_col);
+                        top.rows[0].second = qMax(top.rows[0].second, last_col);
+                    }
+
+                    if (r.bottom() < m_scroll_pixels)
+                        continue;
+
+                    int first_row = qMax(0, (r.top() - m_scroll_pixels) / m_char_height);
+                    int last_row = qMin(m_term->m_lines - 1, (r.bottom() - m_scroll_pixels) / m_char_height);
+
+                    for (int row = first_row; row <= last_row; ++row) {
+                        ctx.rows[row].first = qMin(ctx.rows[row].first, first_col);
+                        ctx.rows[row].second = qMax(ctx.rows[row].second, last_col);
+                    }
+                }
+                
+                {
+                    QMutexLocker locker(&m_term->m_tsm_lock);
+
+                    if (top.rows[0].first <= top.rows[0].second) {
+                        painter.translate(0, m_scroll_pixels - m_char_height);
+                        draw_view(top, m_scroll_offset + 1);
+                        flush_run(top);
+                        painter.translate(0, m_char_height - m_scroll_pixels);
+
+                        ctx.painter_font = top.painter_font;
+                    }
+
+                    // rows are only known at their place while the view is at the bottom
+                    if (!scrolled_back())
+                        ctx.hashes.assign(m_term->m_lines, HASH_SEED);
+
+                    painter.translate(0, m_scroll_pixels);
+                    draw_view(ctx, m_scroll_offset);
+                }
+                flush_run(ctx);
+
+                record_row_hashes(ctx);
+
+                qint64 elapsed = timer.nsecsElapsed();
+
+                m_stats.frames++;
+                m_stats.paint_nsecs += elapsed;
+                m_stats.last_paint_nsecs = elapsed;
+                m_stats.max_paint_nsecs = qMax(m_stats.max_paint_nsecs, elapsed);
+                m_stats.cells_drawn += ctx.cells_drawn;
+                m_stats.cells_skipped += ctx.cells_skipped;
+
+                if (m_term->m_trace)
+                    m_term->m_trace->complete("paint", trace_start, elapsed, "cells", ctx.cells_drawn);
+            }
+            
+            // the paced window is about to repaint, invalidations made now land in this frame
+            bool eventFilter(QObject *watched, QEvent *event) override {
+                if (watched == m_paced_window && event->type() == QEvent::UpdateRequest && m_frame_requested)
+                    present_frame();
+
+                if (watched == m_paced_window && event->type() == QEvent::Expose) {
+                    update_suspension();
+
+                    // restored from minimized
+                    if (m_frame_skipped && view_exposed())
+                        catch_up();
+                }
+
+                return QWidget::eventFilter(watched, event);
+            }
+
+            void keyPressEvent(QKeyEvent *event) override {
+                // handle scrolling keys first (don't send to terminal)
+                if (event->key() == Qt::Key_PageUp && event->modifiers() == Qt::ShiftModifier) {
+                    scroll_up(m_term->m_lines);  // scroll up one page
+                    return;
+                }
+                if (event->key() == Qt::Key_PageDown && event->modifiers() == Qt::ShiftModifier) {
+                    scroll_down(m_term->m_lines);  // scroll down one page
+                    return;
+                }
+                if (event->key() == Qt::Key_Home && event->modifiers() == Qt::ShiftModifier) {
+                    scroll_to_top();
+                    return;
+                }
+                if (event->key() == Qt::Key_End && event->modifiers() == Qt::ShiftModifier) {
+                    scroll_to_bottom();
+                    return;
+                }
+                if ((event->key() == Qt::Key_Insert && event->modifiers() == Qt::ShiftModifier) ||
+                    (event->key() == Qt::Key_V && event->modifiers() == (Qt::ControlModifier | Qt::ShiftModifier))) {
+                    paste_clipboard();
+                    return;
+                }
+                
+                // any other key press should jump to bottom (follow output)
+                if (scrolled_back()) {
+                    scroll_to_bottom();
+                }
+
+                reset_selection();
+
+                QByteArray sequence = translate_key(event);
+
+                // the cursor moves once the echo arrives, with the next frame
+                if (!sequence.isEmpty()) {
+                    m_key_clock.start();
+                    write_to_source(sequence);
+                }
+            }
+
+            static quint64 binding_key(int key, Qt::KeyboardModifiers mods) {
+                return (quint64)(uint)key << 32 | (uint)utils::modifier_index(mods);
+            }
+
+            // bytes a key press sends: the user's binding if any, the keymap otherwise
+            QByteArray translate_key(QKeyEvent *event) {
+                if (!m_key_bindings.isEmpty()) {
+                    auto it = m_key_bindings.constFind(binding_key(event->key(), event->modifiers()));
+                    if (it != m_key_bindings.constEnd())
+                        return *it;
+                }
+
+                // the bytes sent before the keymap, without Alt or Ctrl
+                if (m_legacy_keys && !(utils::modifier_index(event->modifiers()) & ~utils::KEYMAP_SHIFT)) {
+                    if (event->key() == Qt::Key_Return || event->key() == Qt::Key_Enter)
+                        return "\n";
+                    if (event->key() == Qt::Key_Backspace)
+                        return "\x08";
+                }
+
+                bool application = m_cursor_keys == CURSOR_KEYS_APPLICATION ||
+                    (m_cursor_keys == CURSOR_KEYS_AUTO && m_term->application_cursor_keys());
+
+                return utils::key_sequence(event, application);
+            }
+
+            void mousePressEvent(QMouseEvent *event) override {
+                reset_selection();
+
+                m_selection.active = true;
+                px2pos(event->pos(), m_selection.start_column, m_selection.start_line);
+
+            }
+
+            void mouseReleaseEvent(QMouseEvent *event) override {
+                m_selection.active = false;
+                // qDebug() << this->selected_text();
+            }
+
+            void mouseMoveEvent(QMouseEvent *event) override {
+                if (m_selection.active) {
+                    uint col, line;
+                    px2pos(event->pos(), col, line);
+
+                    // motion within the same cell changes nothing
+                    if (m_is_selecting && col == m_selection.end_column && line == m_selection.end_line)
+                        return;
+
+                    m_is_selecting = true;
+                    m_selection.end_column = col;
+                    m_selection.end_line = line;
+
+                    update_selection_span();
+                }
+            }
+            
+            // trackpads report pixels and are followed as they move, coasting on
+            // once the fingers lift unless the platform sends its own momentum.
+            // wheel notches are eased in over SCROLL_ANIMATION_TIME. positive
+            // deltas scroll back into the scrollback
+            void wheelEvent(QWheelEvent *event) override {                
+                if (!m_term->m_screen)
+                    return;
+
+                QPoint pixels = event->pixelDelta();
+
+                if (!pixels.isNull()) {
+                    if (event->phase() == Qt::ScrollBegin || event->phase() == Qt::ScrollMomentum)
+                        m_scroll_velocity = 0;
+
+                    qint64 elapsed = m_scroll_clock.isValid() ? qMax<qint64>(1, m_scroll_clock.restart()) : 0;
+                    if (!m_scroll_clock.isValid())
+                        m_scroll_clock.start();
+
+                    // velocity of the last few updates, what a fling starts with
+                    if (event->phase() == Qt::ScrollUpdate && elapsed > 0)
+                        m_scroll_velocity = 0.7 * m_scroll_velocity + 0.3 * (pixels.y() * 1000.0 / elapsed);
+
+                    scroll_by(pixels.y());
+
+                    if (event->phase() == Qt::ScrollEnd && qAbs(m_scroll_velocity) >= SCROLL_MIN_VELOCITY)
+                        start_scroll_animation();
+                    else if (event->phase() == Qt::ScrollEnd)
+                        m_scroll_velocity = 0;
+
+                    return;
+                }
+
+                int delta = event->angleDelta().y();
+                if (delta == 0)
+                    return;
+
+                m_scroll_velocity = 0;
+                m_scroll_pending += delta / 120.0 * WHEEL_SCROLL_LINES * m_char_height;
+                start_scroll_animation();
+            }
+
+            void start_scroll_animation() {
+                if (m_scroll_timer.isActive())
+                    return;
+
+                m_scroll_clock.start();
+                m_scroll_timer.start(frame_interval());
+            }
+
+            // one animation frame: the eased share of pending notches plus the
+            // distance a fling covers, which slows down with SCROLL_FRICTION
+            void scroll_step() {
+                double dt = qMax<qint64>(1, m_scroll_clock.restart()) / 1000.0;
+                double step = 0;
+
+                if (m_scroll_pending != 0) {
+                    double eased = m_scroll_pending * (1.0 - std::exp(-3.0 * dt * 1000.0 / SCROLL_ANIMATION_TIME));
+
+                    if (qAbs(m_scroll_pending - eased) < 1.0)
+                        eased = m_scroll_pending;
+
+                    step += eased;
+                    m_scroll_pending -= eased;
+                }
+
+                if (m_scroll_velocity != 0) {
+                    step += m_scroll_velocity * dt;
+                    m_scroll_velocity *= std::exp(-SCROLL_FRICTION * dt);
+
+                    if (qAbs(m_scroll_velocity) < SCROLL_MIN_VELOCITY)
+                        m_scroll_velocity = 0;
+                }
+
+                m_scroll_fraction += step;
+                int pixels = (int)m_scroll_fraction;
+                m_scroll_fraction -= pixels;
+
+                // the end of the scrollback stops any motion
+                if (pixels != 0 && !scroll_by(pixels)) {
+                    m_scroll_pending = 0;
+                    m_scroll_velocity = 0;
+                }
+
+                if (m_scroll_pending == 0 && m_scroll_velocity == 0) {
+                    m_scroll_timer.stop();
+                    m_scroll_fraction = 0;
+                }
+            }
+
+            void stop_scroll_animation() {
+                m_scroll_timer.stop();
+                m_scroll_pending = 0;
+                m_scroll_velocity = 0;
+                m_scroll_fraction = 0;
+            }
+
+            bool scrolled_back() const {
+                return m_scroll_offset > 0 || m_scroll_pixels > 0;
+            }
+
+            // pixels the view is scrolled back by
+            long long scroll_position() const {
+                return (long long)m_scroll_offset * m_char_height + m_scroll_pixels;
+            }
+
+            // lines the view can scroll back, the caller holds m_term->m_tsm_lock.
+            // constant time: the history store and the libtsm count both follow
+            // the output as it is parsed, nothing is copied or scanned here
+            int scroll_limit() {
+                if (m_term->m_history) {
+                    m_term->migrate_history();
+                    m_history_seen = m_term->m_history_migrated;
+                    return m_term->m_history->line_count();
+                }
+
+                return m_term->sb_count();
+            }
+
+            bool scroll_by(long long pixels) {
+                return scroll_to_position(scroll_position() + pixels);
+            }
+
+            // move the view to `position` pixels back from the bottom, clamped to
+            // the scrollback. what stays in view is blitted and only the exposed
+            // rows are painted. false when the view did not move
+            bool scroll_to_position(long long position) {
+                if (!m_term->m_screen)
+                    return false;
+
+                QMutexLocker locker(&m_term->m_tsm_lock);
+                long long limit = (long long)scroll_limit() * m_char_height;
+                locker.unlock();
+
+                position = qBound(0LL, position, limit);
+
+                #ifdef QONSOLE_OPENGL
+                // the GL view is built from whole lines
+                if (m_gl)
+                    position -= position % m_char_height;
+                #endif
+
+                long long old = scroll_position();
+                if (position == old)
+                    return false;
+
+                m_scroll_offset = position / m_char_height;
+                m_scroll_pixels = position % m_char_height;
+
+                int dy = (int)qBound<long long>(-height(), position - old, height());
+
+                #ifdef QONSOLE_OPENGL
+                if (m_gl) {
+                    m_gl->update();
+                    return true;
+                }
+                #endif
+
+                // the selection stays on its widget rows, moving it with the text
+                // would be wrong
+                if (!m_incremental_repaint || m_is_selecting || qAbs(dy) >= height()) {
+                    damage();
+                    return true;
+                }
+
+                scroll_view(dy, rect());
+
+                // the cursor is only drawn at the bottom
+                QRect cursor(m_cursor_pos.x * m_char_width, m_cursor_pos.y * m_char_height, m_char_width, m_char_height);
+                if (old == 0)
+                    update(cursor.translated(0, dy));
+                if (position == 0)
+                    update(cursor);
+
+                return true;
+            }
+
+            // cells under `r` changed: the backing image is rendered again there
+            // before the next present, update() alone only presents it
+            void damage(const QRect &r) {
+                if (m_use_backing)
+                    m_backing_dirty += r;
+
+                update(r);
+            }
+
+            void damage() {
+                damage(rect());
+            }
+
+            // move the pixels of `r` by dy, in the backing image when there is one,
+            // leaving the uncovered part to be rendered
+            void scroll_view(int dy, const QRect &r) {
+                if (!m_use_backing || m_backing.isNull()) {
+                    scroll(0, dy, r);
+                    return;
+                }
+
+                QRect dest = r.intersected(r.translated(0, dy));
+                QRect src = dest.translated(0, -dy);
+                qreal dpr = m_backing.devicePixelRatio();
+
+                if (!dest.isEmpty()) {
+                    QImage band = m_backing.copy(QRect(
+                        qRound(src.x() * dpr), qRound(src.y() * dpr),
+                        qRound(src.width() * dpr), qRound(src.height() * dpr)
+                    ));
+
+                    QPainter painter(&m_backing);
+                    painter.setCompositionMode(QPainter::CompositionMode_Source);
+                    painter.drawImage(QRectF(dest), band, QRectF(band.rect()));
+                }
+
+                // what was still to be rendered moves along, the rest of `r` is exposed
+                QRegion moved = m_backing_dirty.intersected(r).translated(0, dy).intersected(dest);
+                m_backing_dirty = m_backing_dirty.subtracted(QRegion(r)) + moved + QRegion(r).subtracted(QRegion(dest));
+
+                // the overlay stays where it is, present the whole band again
+                update(r);
+            }
+
+            void update_cursor_pos() {
+                q_cursor_pos old = m_cursor_pos;
+
+                {
+                    QMutexLocker locker(&m_term->m_tsm_lock);
+                    m_cursor_pos.x = tsm_screen_get_cursor_x(m_term->m_screen);
+                    m_cursor_pos.y = tsm_screen_get_cursor_y(m_term->m_screen);
+                }
+
+                if (!m_incremental_repaint) {
+                    update();
+                    return;
+                }
+
+                // repaint the cells the cursor left and entered
+                update(QRect(pos2px(old.x, old.y), QSize(m_char_width, m_char_height)));
+                update(QRect(pos2px(m_cursor_pos.x, m_cursor_pos.y), QSize(m_char_width, m_char_height)));
+            }
+
+            // scan the screen for cells changed since the last scan, and schedule
+            // a repaint of the dirty row spans only. rows already painted with the
+            // same content are left alone, and when output scrolled the screen the
+            // rows still shown are blitted to their new place
+            void update_damage() {
+                if (!m_term->m_screen)
+                    return;
+
+                if (!m_incremental_repaint) {
+                    damage();
+                    return;
+                }
+
+                q_damage_context ctx;
+                ctx.widget = this;
+                ctx.since = m_last_age;
+                ctx.rows.assign(m_term->m_lines, {m_term->m_cols, -1});
+                ctx.hashes.assign(m_term->m_lines, HASH_SEED);
+
+                {
+                    QMutexLocker locker(&m_term->m_tsm_lock);
+                    sync_view_scroll();
+                    m_last_age = tsm_screen_draw(m_term->m_screen, damage_callback, &ctx);
+                }
+
+                for (quint64 &hash : ctx.hashes)
+                    hash |= 1;
+
+                // a forced full repaint trusts nothing painted so far
+                bool known = ctx.since != 0 && !scrolled_back() && (int)m_row_hashes.size() == m_term->m_lines
+                    && m_resize_frame.isNull();
+
+                #ifdef QONSOLE_OPENGL
+                known = known && !m_gl;
+                #endif
+
+                if (known)
+                    blit_scrolled_rows(ctx);
+
+                for (int row = 0; row < m_term->m_lines; ++row) {
+                    const std::pair<int, int> &span = ctx.rows[row];
+
+                    if (span.first > span.second)
+                        continue;
+
+                    if (known && m_row_hashes[row] == ctx.hashes[row])
+                        continue;
+
+                    damage(QRect(
+                        span.first * m_char_width,
+                        row * m_char_height,
+                        (span.second - span.first + 1) * m_char_width,
+                        m_char_height
+                    ));
+                }
+            }
+
+            // find the shift that lets the most changed rows be blitted from rows
+            // painted above or below them, over one contiguous band (the whole
+            // screen or a scroll region), and move those pixels with scroll()
+            void blit_scrolled_rows(q_damage_context &ctx) {
+                const int lines = m_term->m_lines;
+                const std::vector<quint64> &now = ctx.hashes;
+
+                int changed = 0;
+                for (int row = 0; row < lines; ++row)
+                    changed += m_row_hashes[row] != now[row];
+
+                if (changed < 2)
+                    return;
+
+                int best_shift = 0, best_first = 0, best_last = -1, best_score = 0;
+
+                // small shifts first, they win ties
+                for (int distance = 1; distance < lines && best_score < changed; ++distance) {
+                    for (int shift : {distance, -distance}) {
+                        int first = -1, score = 0;
+
+                        for (int row = qMax(0, -shift); row <= qMin(lines - 1, lines - 1 - shift) + 1; ++row) {
+                            bool movable = row <= qMin(lines - 1, lines - 1 - shift)
+                                && m_row_hashes[row + shift] != 0 && m_row_hashes[row + shift] == now[row];
+
+                            if (movable) {
+                                if (first < 0)
+                                    first = row;
+
+                                if (m_row_hashes[row] != now[row])
+                                    score++;
+
+                                continue;
+                            }
+
+                            if (first >= 0 && score > best_score) {
+                                best_shift = shift;
+                                best_first = first;
+                                best_last = row - 1;
+                                best_score = score;
+                            }
+
+                            first = -1;
+                            score = 0;
+                        }
+                    }
+                }
+
+                // a single row is as cheap to paint as to blit
+                if (best_score < 2)
+                    return;
+
+                int top = qMin(best_first, best_first + best_shift);
+                int bottom = qMax(best_last, best_last + best_shift);
+
+                scroll_view(-best_shift * m_char_height,
+                            QRect(0, top * m_char_height, m_term->m_cols * m_char_width, (bottom - top + 1) * m_char_height));
+
+                std::vector<quint64> before = m_row_hashes;
+
+                // rows of the band left uncovered are exposed and repainted in full
+                for (int row = top; row <= bottom; ++row)
+                    m_row_hashes[row] = 0;
+
+                for (int row = best_first; row <= best_last; ++row) {
+                    m_row_hashes[row] = before[row + best_shift];
+                    ctx.rows[row] = {m_term->m_cols, -1};
+                }
+            }
+
+            // remember what the rows painted in full show, the rest is unknown
+            void record_row_hashes(const q_draw_context &ctx) {
+                if ((int)m_row_hashes.size() != m_term->m_lines)
+                    m_row_hashes.assign(m_term->m_lines, 0);
+
+                for (int row = 0; row < m_term->m_lines; ++row) {
+                    const std::pair<int, int> &span = ctx.rows[row];
+
+                    if (span.first > span.second)
+                        continue;
+
+                    bool full = !ctx.hashes.empty() && span.first == 0 && span.second == m_term->m_cols - 1;
+                    m_row_hashes[row] = full ? ctx.hashes[row] | 1 : 0;
+                }
+
+                // the cursor is painted on top of its cell, unless it is an overlay
+                if (!m_use_backing && !scrolled_back() && (int)m_cursor_pos.y < m_term->m_lines)
+                    m_row_hashes[m_cursor_pos.y] = 0;
+            }
+
+            enum : quint64 { HASH_SEED = 0xcbf29ce484222325ULL, HASH_PRIME = 0x100000001b3ULL };
+
+            // fold one cell into its row's hash, covering what painting it depends on
+            static quint64 cell_hash(quint64 hash, const uint32_t *ch, size_t len, unsigned int width,
+                                     unsigned int posx, const tsm_screen_attr *attr, bool selected) {
+                quint64 colors = (quint64)(uint8_t)attr->fccode | (quint64)(uint8_t)attr->bccode << 8
+                    | (quint64)attr->fr << 16 | (quint64)attr->fg << 24 | (quint64)attr->fb << 32
+                    | (quint64)attr->br << 40 | (quint64)attr->bg << 48 | (quint64)attr->bb << 56;
+
+                quint64 flags = attr->bold | attr->underline << 1 | attr->inverse << 2 | (selected ? 8 : 0)
+                    | (quint64)width << 8 | (quint64)len << 16 | (quint64)posx << 32;
+
+                hash = (hash ^ colors) * HASH_PRIME;
+                hash = (hash ^ flags) * HASH_PRIME;
+
+                for (size_t i = 0; i < len; ++i)
+                    hash = (hash ^ ch[i]) * HASH_PRIME;
+
+                return hash;
+            }
+
+            void update_metrics() {
+                m_font.setStyleHint(QFont::TypeWriter);
+                m_font.setFixedPitch(true);
+                
+                m_font.setLetterSpacing(QFont::AbsoluteSpacing, 0);
+
+                QFontMetrics fm(m_font);
+                m_char_width = fm.horizontalAdvance('M');
+                m_char_height = fm.height();
+
+                // runs are drawn as a single string, pin every advance to the
+                // integer cell width so text does not drift off the grid
+                QFontMetricsF fmf(m_font);
+                m_font.setLetterSpacing(QFont::AbsoluteSpacing, m_char_width - fmf.horizontalAdvance('M'));
+
+                for (int variant = 0; variant < FONT_VARIANTS; ++variant) {
+                    q_font_face &face = m_faces[variant];
+                    face.font = m_font;
+
+                    if (variant & FONT_BOLD) {
+                        face.font.setBold(true);
+                        face.font.setLetterSpacing(QFont::AbsoluteSpacing, 0);
+
+                        QFontMetricsF bold(face.font);
+                        face.font.setLetterSpacing(QFont::AbsoluteSpacing, m_char_width - bold.horizontalAdvance('M'));
+                    }
+
+                    QFontMetrics metrics(face.font);
+                    face.underline_pos = metrics.underlinePos();
+                    face.line_width = qMax(1, metrics.lineWidth());
+                }
+            }
+
+            void draw_cursor(QPainter &painter) {
+                if (m_qcstyle == q_cursor_style::NONE) {
+                    return;
+                }
+
+                // If cursor style is IBEAM or UNDERLINE and widget does not have focus, do not draw cursor
+                if ((
+                        m_qcstyle == q_cursor_style::IBEAM || 
+                        m_qcstyle == q_cursor_style::UNDERLINE
+                    ) && !hasFocus()) {
+                    return;
+                }
+
+                // otherwise draw full cursor, if has focus, if not draw only cursor border
+                int x = m_cursor_pos.x * m_char_width;
+                int y = m_cursor_pos.y * m_char_height;
+
+                // if block cursor
+                if (m_qcstyle == q_cursor_style::BLOCK) {
+                    painter.fillRect(x, y, m_char_width, m_char_height, m_default_fg);
+                }
+                // if underline cursor
+                else if (m_qcstyle == q_cursor_style::UNDERLINE) {
+                    painter.fillRect(x, y + m_char_height - 2, m_char_width, 2, m_default_fg);
+                }
+                // if IBEAM cursor
+                else if (m_qcstyle == q_cursor_style::IBEAM) {
+                    painter.fillRect(x + (m_char_width / 2) - 1, y, 2, m_char_height, m_default_fg);
+                }
+            }
+
+            void draw_screen(QPainter &painter) {
+                painter.fillRect(rect(), m_default_bg);
+            }
+
+            // return the pixmap of a single-codepoint cell, rendering it on a miss
+            const QPixmap& cached_glyph(uint32_t cp, unsigned int width, int font, QRgb fg) {
+                quint64 key = static_cast<quint64>(cp & 0x1FFFFF)
+                    | static_cast<quint64>(font & 0x3) << 21
+                    | static_cast<quint64>(width & 0x3) << 23
+                    | static_cast<quint64>(fg & 0xFFFFFF) << 32;
+
+                auto it = m_glyph_cache.find(key);
+                if (it != m_glyph_cache.end())
+                    return *it;
+
+                if (m_glyph_cache.size() >= GLYPH_CACHE_SIZE)
+                    m_glyph_cache.clear();
+
+                int w = m_char_width * (width > 0 ? width : 1);
+
+                QPixmap glyph(qRound(w * m_glyph_dpr), qRound(m_char_height * m_glyph_dpr));
+                glyph.setDevicePixelRatio(m_glyph_dpr);
+                glyph.fill(Qt::transparent);
+
+                char32_t c = cp;
+                QPainter painter(&glyph);
+                painter.setFont(m_faces[font].font);
+                painter.setPen(QColor::fromRgb(fg));
+                painter.drawText(0, m_char_height - 3, QString::fromUcs4(&c, 1));
+                painter.end();
+
+                return *m_glyph_cache.insert(key, glyph);
+            }
+
+            // paint a run: one background rect, then one drawText or per-cell glyph
+            // blits, and the underline as one line across the run
+            void flush_run(q_draw_context &ctx) {
+                QPainter &painter = *ctx.painter;
+                q_run &run = ctx.run;
+
+                if (run.cells == 0)
+                    return;
+
+                int x = run.first * m_char_width;
+                int y = run.row * m_char_height;
+                int cell_width = m_char_width * run.width;
+
+                painter.fillRect(x, y, cell_width * run.cells, m_char_height, QColor::fromRgba(run.bg));
+
+                if (m_use_glyph_cache && run.simple) {
+                    for (int i = 0; i < run.cells; ++i) {
+                        if (run.text[i] == U' ')
+                            continue;
+
+                        painter.drawPixmap(
+                            x + i * cell_width, y,
+                            cached_glyph(run.text[i], run.width, run.font, run.fg)
+                        );
+                    }
+                }
+                else {
+                    if (ctx.painter_font != run.font) {
+                        painter.setFont(m_faces[run.font].font);
+                        ctx.painter_font = run.font;
+                    }
+
+                    painter.setPen(QColor::fromRgb(run.fg));
+                    painter.drawText(
+                        x, y + m_char_height - 3,
+                        QString::fromUcs4(run.text.data(), run.text.size())
+                    );
+                }
+
+                if (run.underline) {
+                    const q_font_face &face = m_faces[run.font];
+                    painter.fillRect(
+                        x, y + m_char_height - 3 + face.underline_pos,
+                        cell_width * run.cells, face.line_width,
+                        QColor::fromRgb(run.fg)
+                    );
+                }
+
+                run.cells = 0;
+                run.text.clear();
+            }
+
+            bool is_selected(uint col, uint line) {
+                if (line >= m_selection_span.size())
+                    return false;
+
+                const std::pair<int, int> &span = m_selection_span[line];
+                return (int)col >= span.first && (int)col <= span.second;
+            }
+
+            // on the last match, which stays on its line while the view scrolls and
+            // output pushes lines off the screen. the caller holds m_term->m_tsm_lock
+            bool is_matched(uint col, uint line) {
+                if (!m_match_shown || (int)col < m_last_match.start_column || (int)col > m_last_match.end_column)
+                    return false;
+
+                long long row = (long long)(m_last_match.line - m_term->screen_line()) + m_scroll_offset;
+                return row == (long long)line;
+            }
+
+            // recompute the per-row selected columns from m_selection, and repaint
+            // only the rows whose selected columns changed
+            void update_selection_span() {
+                std::vector<std::pair<int, int>> span(m_term->m_lines, {0, -1});
+
+                if (m_is_selecting) {
+                    int sl = m_selection.start_line;
+                    int sc = m_selection.start_column;
+                    int el = m_selection.end_line;
+                    int ec = m_selection.end_column;
+
+                    // Normalize selection (ensure (sl,sc) <= (el,ec))
+                    if (sl > el || (sl == el && sc > ec)) {
+                        std::swap(sl, el);
+                        std::swap(sc, ec);
+                    }
+
+                    for (int line = qMax(sl, 0); line <= el && line < m_term->m_lines; ++line) {
+                        span[line].first = (line == sl) ? qBound(0, sc, m_term->m_cols - 1) : 0;
+                        span[line].second = (line == el) ? qBound(0, ec, m_term->m_cols - 1) : m_term->m_cols - 1;
+                    }
+                }
+
+                size_t rows = qMax(span.size(), m_selection_span.size());
+
+                for (size_t line = 0; line < rows; ++line) {
+                    std::pair<int, int> before = line < m_selection_span.size() ? m_selection_span[line] : std::make_pair(0, -1);
+                    std::pair<int, int> after = line < span.size() ? span[line] : std::make_pair(0, -1);
+
+                    if (before == after || (before.first > before.second && after.first > after.second))
+                        continue;
+
+                    int first = before.first > before.second ? after.first
+                              : after.first > after.second ? before.first
+                              : qMin(before.first, after.first);
+                    int last = qMax(before.second, after.second);
+
+                    update(first * m_char_width, line * m_char_height + m_scroll_pixels, (last - first + 1) * m_char_width, m_char_height);
+                }
+
+                m_selection_span.swap(span);
+            }
+
+            // call fn(ch, len, width, col, row, attr) for each cell of the scrollback
+            // lines shown in the first `rows` rows of a view scrolled back `offset`
+            // lines, the caller holds m_tsm_lock
+            template<typename F>
+            void for_each_history_cell(int offset, unsigned int rows, F fn) {
+                q_history_line line;
+                long long first = (long long)m_term->m_history->line_count() - offset;
+
+                for (unsigned int row = 0; row < rows; ++row) {
+                    if (first + row < 0 || !m_term->m_history->line(first + row, line))
+                        continue;
+
+                    unsigned int col = 0;
+
+                    line.for_each_cell([&](const char32_t *ch, size_t len, const q_history_run &run) {
+                        const uint32_t *cell = reinterpret_cast<const uint32_t*>(ch);
+
+                        // blanks are reported empty, as libtsm does
+                        fn(cell, len == 1 && ch[0] == U' ' ? 0 : len, run.width, col, row, &run.attr);
+                        col += run.width;
+                    });
+                }
+            }
+
+            // draw the view scrolled back `offset` lines: scrollback lines in the top
+            // rows, then the screen pushed down. the caller holds m_tsm_lock
+            void draw_view(q_draw_context &ctx, int offset) {
+                ctx.offset = offset;
+                ctx.row_shift = 0;
+
+                if (m_term->m_history && offset > 0) {
+                    ctx.row_shift = qMin(offset, m_term->m_lines);
+                    draw_history(ctx);
+                }
+
+                if ((int)ctx.row_shift < m_term->m_lines) {
+                    m_term->sb_set(m_term->m_history ? 0 : offset);
+                    tsm_screen_draw(m_term->m_screen, draw_callback, &ctx);
+                }
+            }
+
+            // draw the scrollback lines shown above the screen, the caller holds m_tsm_lock
+            void draw_history(q_draw_context &ctx) {
+                for_each_history_cell(ctx.offset, ctx.row_shift, [&](const uint32_t *ch, size_t len, unsigned int width,
+                                                         unsigned int col, unsigned int row, const tsm_screen_attr *attr) {
+                    if (ctx.rows[row].first <= ctx.rows[row].second)
+                        draw_cell(ctx, ch, len, width, col, row, attr);
+                });
+            }
+
+            // libtsm resolves 256-color and truecolor codes itself, leaving a negative
+            // code and the color in the attribute's rgb fields
+            QRgb resolve_color(int8_t code, uint8_t r, uint8_t g, uint8_t b, QRgb fallback) const {
+                if (code < 0)
+                    return qRgb(r, g, b);
+
+                return code < COLOR_CODES ? m_color_table[code] : fallback;
+            }
+
+            void resolve_colors(const struct tsm_screen_attr *attr, bool selected, bool matched, QRgb &fg, QRgb &bg) {
+                fg = resolve_color(attr->fccode, attr->fr, attr->fg, attr->fb, m_color_table[COLOR_FOREGROUND]);
+                bg = resolve_color(attr->bccode, attr->br, attr->bg, attr->bb, m_color_table[COLOR_BACKGROUND]);
+                
+                // Handle inverse
+                if (attr->inverse) {
+                    std::swap(fg, bg);
+                }
+                
+                // Draw background
+                if (selected) {
+                    bg = m_packed_selection;
+                }
+                else if (matched) {
+                    bg = m_packed_match;
+                }
+            }
+
+            static int draw_callback(
+                struct tsm_screen* screen,
+                uint64_t id,
+                const uint32_t* ch,
+                size_t len,
+                unsigned int width,
+                unsigned int posx,
+                unsigned int posy,
+                const struct tsm_screen_attr* attr,
+                tsm_age_t age,
+                void* data
+            ) {
+                q_draw_context* ctx = static_cast<q_draw_context*>(data);
+                QonsoleWidget* self = ctx->widget;
+                
+                if (!self) {
+                    qDebug() << "tsm: invalid data passed.";
+                    return 0;
+                }
+
+                if (posy < ctx->hashes.size())
+                    ctx->hashes[posy] = cell_hash(ctx->hashes[posy], ch, len, width, posx, attr,
+                                                  (ctx->selectable && self->is_selected(posx, posy)) || self->is_matched(posx, posy));
+
+                self->draw_cell(*ctx, ch, len, width, posx, posy + ctx->row_shift, attr);
+                return 0;
+            }
+
+            // batch one cell into the current run, `posy` is the widget row
+            void draw_cell(
+                q_draw_context &ctx,
+                const uint32_t* ch,
+                size_t len,
+                unsigned int width,
+                unsigned int posx,
+                unsigned int posy,
+                const struct tsm_screen_attr* attr
+            ) {
+                // continuation of a wide character, painted along with it
+                if (width == 0)
+                    return;
+
+                bool iss = ctx.selectable && is_selected(posx, posy);
+                bool matched = is_matched(posx, posy);
+
+                // if not empty cell or it's selected then draw it otherwise do not
+                // in case did not check if selecting, empty cells including spaces for some reason
+                // (libtsm) won't be drawn at all
+                if (len == 0 && !iss && !matched) {
+                    if (!m_draw_empty_cells) {
+                        ctx.cells_skipped++;
+                        return;
+                    }
+                }
+                
+                // skip cells outside of the paint region
+                if (posy >= ctx.rows.size()) {
+                    ctx.cells_skipped++;
+                    return;
+                }
+
+                const std::pair<int, int> &span = ctx.rows[posy];
+                int last_col = posx + width - 1;
+
+                if (last_col < span.first || (int)posx > span.second) {
+                    ctx.cells_skipped++;
+                    return;
+                }
+
+                ctx.cells_drawn++;
+                
+                // Get colors
+                QRgb fg, bg;
+                resolve_colors(attr, iss, matched, fg, bg);
+
+                q_run &run = ctx.run;
+                int font = m_use_bold && attr->bold ? FONT_BOLD : FONT_REGULAR;
+                bool underline = attr->underline;
+
+                // extend the current run if contiguous and attributes match,
+                // wide cells get a run of their own
+                bool extends = run.cells > 0
+                    && run.row == (int)posy
+                    && run.first + run.cells == (int)posx
+                    && run.width == 1 && width == 1
+                    && run.font == font && run.underline == underline
+                    && run.fg == fg && run.bg == bg;
+
+                if (!extends) {
+                    flush_run(ctx);
+
+                    run.row = posy;
+                    run.first = posx;
+                    run.width = width;
+                    run.fg = fg;
+                    run.bg = bg;
+                    run.font = font;
+                    run.underline = underline;
+                    run.simple = true;
+                }
+
+                if (len > 0) {
+                    run.text.append(reinterpret_cast<const char32_t*>(ch), len);
+                    run.simple = run.simple && len == 1;
+                }
+                else {
+                    static const std::u32string replacement = QString(EMPTY_CELL_REPLACEMENT).toStdU32String();
+                    run.text.append(replacement);
+                    run.simple = run.simple && replacement.size() == 1;
+                }
+
+                run.cells++;
+            }
+
+            static int damage_callback(
+                struct tsm_screen* screen,
+                uint64_t id,
+                const uint32_t* ch,
+                size_t len,
+                unsigned int width,
+                unsigned int posx,
+                unsigned int posy,
+                const struct tsm_screen_attr* attr,
+                tsm_age_t age,
+                void* data
+            ) {
+                Q_UNUSED(screen);
+                Q_UNUSED(id);
+
+                q_damage_context* ctx = static_cast<q_damage_context*>(data);
+
+                if (posy >= ctx->rows.size())
+                    return 0;
+
+                // the backing image does not hold the selection, it does hold the match
+                bool selected = (!ctx->widget->m_use_backing && ctx->widget->is_selected(posx, posy))
+                             || ctx->widget->is_matched(posx, posy);
+                ctx->hashes[posy] = cell_hash(ctx->hashes[posy], ch, len, width, posx, attr, selected);
+
+                // age 0 means libtsm wants the cell redrawn unconditionally
+                if (age == 0 || age > ctx->since) {
+                    std::pair<int, int> &span = ctx->rows[posy];
+                    span.first = qMin(span.first, (int)posx);
+                    span.second = qMax(span.second, (int)(posx + (width > 0 ? width : 1) - 1));
+                }
+
+                return 0;
+            }
+
+            #ifdef QONSOLE_OPENGL
+            static int gl_callback(
+                struct tsm_screen* screen,
+                uint64_t id,
+                const uint32_t* ch,
+                size_t len,
+                unsigned int width,
+                unsigned int posx,
+                unsigned int posy,
+                const struct tsm_screen_attr* attr,
+                tsm_age_t age,
+                void* data
+            ) {
+                Q_UNUSED(screen);
+                Q_UNUSED(id);
+                Q_UNUSED(age);
+
+                q_gl_context* ctx = static_cast<q_gl_context*>(data);
+                ctx->widget->gl_cell(*ctx->gl, ch, len, width, posx, posy + ctx->row_shift, attr);
+
+                return 0;
+            }
+
+            // queue one cell as an instance of the OpenGL renderer, `posy` is the widget row
+            void gl_cell(
+                QonsoleGLRenderer &gl,
+                const uint32_t* ch,
+                size_t len,
+                unsigned int width,
+                unsigned int posx,
+                unsigned int posy,
+                const struct tsm_screen_attr* attr
+            ) {
+                if (width == 0 || posy >= (unsigned int)m_term->m_lines)
+                    return;
+
+                QRgb fg, bg;
+                resolve_colors(attr, is_selected(posx, posy), is_matched(posx, posy), fg, bg);
+
+                const QRgb default_fg = m_color_table[COLOR_FOREGROUND];
+                const QRgb default_bg = m_color_table[COLOR_BACKGROUND];
+
+                // the selection tint is translucent, blend it here as the shader does not
+                if (qAlpha(bg) < 255) {
+                    int a = qAlpha(bg);
+                    auto blend = [a](int over, int under) { return (over * a + under * (255 - a)) / 255; };
+
+                    bg = qRgb(
+                        blend(qRed(bg), qRed(default_bg)),
+                        blend(qGreen(bg), qGreen(default_bg)),
+                        blend(qBlue(bg), qBlue(default_bg))
+                    );
+                }
+
+                uint32_t flags = (width > 1 ? GL_CELL_WIDE : 0) | (attr->underline ? GL_CELL_UNDERLINE : 0);
+
+                if (m_scroll_offset == 0 && posx == m_cursor_pos.x && posy == m_cursor_pos.y) {
+                    if (m_qcstyle == q_cursor_style::BLOCK) {
+                        fg = default_bg;
+                        bg = default_fg;
+                    }
+                    else if (hasFocus() && m_qcstyle == q_cursor_style::UNDERLINE) {
+                        flags |= GL_CELL_CURSOR_UNDERLINE;
+                        fg = default_fg;
+                    }
+                    else if (hasFocus() && m_qcstyle == q_cursor_style::IBEAM) {
+                        flags |= GL_CELL_CURSOR_IBEAM;
+                        fg = default_fg;
+                    }
+                }
+
+                // blank cells on the cleared background need no instance
+                if (len == 0 && flags == 0 && bg == default_bg)
+                    return;
+
+                int font = m_use_bold && attr->bold ? FONT_BOLD : FONT_REGULAR;
+                quint32 glyph = len > 0
+                    ? gl.glyph_slot(m_faces[font].font, font, ch, len, width, m_char_height - 3)
+                    : 0;
+
+                gl.push_cell(posx, posy, glyph, flags, fg, bg);
+            }
+
+            // fill the renderer's instances with the whole view
+            void build_gl_cells(QonsoleGLRenderer &gl) {
+                gl.clear_cells();
+                gl.ensure_atlas(m_char_width, m_char_height);
+
+                if (!m_term->m_screen)
+                    return;
+
+                q_gl_context ctx {this, &gl};
+
+                QMutexLocker locker(&m_term->m_tsm_lock);
+
+                if (m_term->m_history && m_scroll_offset > 0) {
+                    ctx.row_shift = qMin(m_scroll_offset, m_term->m_lines);
+
+                    for_each_history_cell(m_scroll_offset, ctx.row_shift, [&](const uint32_t *ch, size_t len, unsigned int width,
+                                                             unsigned int col, unsigned int row, const tsm_screen_attr *attr) {
+                        gl_cell(gl, ch, len, width, col, row, attr);
+                    });
+                }
+
+                if ((int)ctx.row_shift < m_term->m_lines) {
+                    sync_view_scroll();
+                    tsm_screen_draw(m_term->m_screen, gl_callback, &ctx);
+                }
+            }
+
+            void resizeEvent(QResizeEvent *event) override {
+                QWidget::resizeEvent(event);
+
+                if (m_gl)
+                    m_gl->setGeometry(rect());
+            }
+            #endif // QONSOLE_OPENGL
+
+            int frame_interval() {
+                qreal hz = screen() ? screen()->refreshRate() : 60.0;
+                return qMax(1, qRound(1000.0 / (hz > 0 ? hz : 60.0)));
+            }
+
+            // top-level window frames are requested from, watched so its update
+            // requests reach eventFilter()
+            QWindow* pacing_window() {
+                QWindow *w = (isVisible() && window()) ? window()->windowHandle() : nullptr;
+
+                if (w != m_paced_window) {
+                    if (m_paced_window)
+                        m_paced_window->removeEventFilter(this);
+                    if (w)
+                        w->installEventFilter(this);
+
+                    m_paced_window = w;
+                }
+
+                return w;
+            }
+
+            // fold invalidations into the next frame: the window's next update request,
+            // vsync paced where the platform supports it, or without a window a frame
+            // interval after the last one. in latency mode the echo of a recent
+            // keystroke is presented right away
+            void schedule_frame() {
+                // nobody sees a hidden, minimized or occluded view, it catches up once shown
+                if (!view_exposed()) {
+                    m_frame_skipped = true;
+                    return;
+                }
+
+                if (m_pacing == LATENCY && m_key_clock.isValid() && m_key_clock.elapsed() < ECHO_WINDOW) {
+                    present_frame();
+                    return;
+                }
+
+                if (m_frame_requested || m_frame_timer.isActive())
+                    return;
+
+                if (QWindow *w = pacing_window()) {
+                    m_frame_requested = true;
+                    w->requestUpdate();
+
+                    // hidden or unexposed windows may never deliver it
+                    m_frame_timer.start(FRAME_REQUEST_TIMEOUT);
+                    return;
+                }
+
+                qint64 interval = frame_interval();
+                qint64 elapsed = m_frame_clock.isValid() ? m_frame_clock.elapsed() : interval;
+
+                if (elapsed >= interval) {
+                    present_frame();
+                }
+                else {
+                    m_frame_timer.start(interval - elapsed);
+                }
+            }
+
+            void present_frame() {
+                m_frame_requested = false;
+                m_frame_timer.stop();
+                m_frame_clock.start();
+
+                #ifdef QONSOLE_OPENGL
+                // the whole view is redrawn, damage tracking only drives the cursor
+                if (m_gl)
+                    m_gl->update();
+                #endif
+
+                // while scrolled back into the budgeted scrollback, the view stays
+                // on the same lines as new ones arrive
+                if (m_term->m_history && m_scroll_offset > 0) {
+                    {
+                        QMutexLocker locker(&m_term->m_tsm_lock);
+                        m_term->migrate_history();
+
+                        size_t migrated = m_term->m_history_migrated;
+                        m_scroll_offset = qMin<size_t>(
+                            m_scroll_offset + (migrated - m_history_seen),
+                            m_term->m_history->line_count()
+                        );
+                        m_history_seen = migrated;
+                    }
+
+                    // the shown screen rows are shifted, the damage scan does not apply
+                    damage();
+                    return;
+                }
+
+                // the damage scan knows whole rows only
+                if (m_scroll_pixels > 0) {
+                    damage();
+                    return;
+                }
+
+                // damage first, a blit would carry along invalidations made before it
+                update_damage();
+
+                // Only update cursor and auto-scroll if we're at the bottom
+                if (m_scroll_offset == 0) {
+                    update_cursor_pos();
+                }
+            }
+
+            // libtsm's scroll position is shared, this view's own is applied before
+            // it draws. the caller holds m_term->m_tsm_lock
+            void sync_view_scroll() {
+                m_term->sb_set(m_term->m_history ? 0 : m_scroll_offset);
+            }
+
+            bool view_exposed() {
+                if (!isVisible() || (window() && window()->isMinimized()))
+                    return false;
+
+                QWindow *w = pacing_window();
+                return !w || w->isExposed();
+            }
+
+            // follow the view's visibility into the terminal's suspension, which
+            // only happens once every view suspending it is hidden
+            void update_suspension() {
+                bool exposed = m_suspend_hidden && view_exposed();
+
+                if (m_suspend_hidden == m_counted_view && exposed == m_counted_exposed)
+                    return;
+
+                bool was_hidden = m_counted_view && !m_counted_exposed;
+
+                m_term->track_view_exposure(int(m_suspend_hidden) - int(m_counted_view),
+                                            int(exposed) - int(m_counted_exposed));
+                m_counted_view = m_suspend_hidden;
+                m_counted_exposed = exposed;
+
+                // this view just went hidden
+                if (!m_suspend_hidden || exposed || was_hidden)
+                    return;
+
+                m_frame_skipped = true;
+
+                if (m_drop_caches_hidden) {
+                    m_glyph_cache.clear();
+                    m_backing = QImage();
+
+                    #ifdef QONSOLE_OPENGL
+                    if (m_gl)
+                        m_gl->reset_atlas(m_char_width, m_char_height);
+                    #endif
+                }
+            }
+
+            // skipped frames are folded into a full one
+            void catch_up() {
+                m_frame_skipped = false;
+                m_last_age = 0;
+                damage();
+                schedule_frame();
+            }
+
+            void showEvent(QShowEvent *event) override {
+                QWidget::showEvent(event);
+                update_suspension();
+
+                if (m_frame_skipped)
+                    catch_up();
+            }
+
+            void hideEvent(QHideEvent *event) override {
+                QWidget::hideEvent(event);
+                update_suspension();
+            }
+
+            // the size settled, a drag back to where it started changes nothing
+            void apply_resize() {
+                m_resize_timer.stop();
+                m_resize_frame = QImage();
+
+                if (m_resize_pending.width() == m_term->m_cols && m_resize_pending.height() == m_term->m_lines) {
+                    on_resized();
+                    return;
+                }
+
+                m_term->resize(m_resize_pending.width(), m_resize_pending.height());
+            }
+
+            // render the whole grid once, shown scaled until the resize applies
+            void capture_resize_frame() {
+                #ifdef QONSOLE_OPENGL
+                if (m_gl)
+                    return;
+                #endif
+
+                if (!m_term->m_screen)
+                    return;
+
+                qreal dpr = devicePixelRatioF();
+                QRect grid(0, 0, m_term->m_cols * m_char_width, m_term->m_lines * m_char_height);
+
+                m_resize_frame = QImage(qRound(grid.width() * dpr), qRound(grid.height() * dpr), QImage::Format_ARGB32_Premultiplied);
+                m_resize_frame.setDevicePixelRatio(dpr);
+
+                QPainter painter(&m_resize_frame);
+                render_cells(painter, grid, true);
+
+                // those rows were not painted into the view
+                m_row_hashes.clear();
+            }
+
+            // geometry changed, next damage scan starts from scratch
+            void on_resized() {
+                m_last_age = 0;
+                m_row_hashes.clear();
+                damage();
+            }
+
+            void on_screen_reset() {
+                stop_scroll_animation();
+                m_scroll_offset = 0;
+                m_scroll_pixels = 0;
+                m_last_age = 0;
+                reset_selection();
+                clear_search();
+                damage();
+            }
+
+            // output of a subclass' own, see QonsoleTerminal::on_data_ready()
+            void on_data_ready(QByteArray data) {
+                m_term->on_data_ready(data);
+            }
+
+            void load_default_palette() {
+                // Default theme: Credit to <https://draculatheme.com/>
+                m_palette[0]  = QColor("#21222C"); // Black
                 m_palette[1]  = QColor("#FF5555"); // Red
                 m_palette[2]  = QColor("#50FA7B"); // Green
                 m_palette[3]  = QColor("#F1FA8C"); // Yellow
@@ -747,354 +6250,1110 @@ namespace qonsole {
                 
                 m_default_fg = m_palette[7];
                 m_default_bg = m_palette[0];
-                m_selection_bg = QColor(255, 255, 255, 40);
+                m_selection_bg = QColor(255, 255, 255, 40);
+                m_match_bg = QColor(255, 184, 108, 110);
+
+                build_color_table();
+            }
+
+            // pack the palette once so cells resolve their colors with a table lookup
+            void build_color_table() {
+                for (int i = 0; i < 16; ++i)
+                    m_color_table[i] = m_palette[i].rgb();
+
+                m_color_table[COLOR_FOREGROUND] = m_default_fg.rgb();
+                m_color_table[COLOR_BACKGROUND] = m_default_bg.rgb();
+                m_packed_selection = m_selection_bg.rgba();
+                m_packed_match = m_match_bg.rgba();
+            }
+
+        public:
+            QonsoleWidget(QWidget*parent) : QonsoleWidget(new QonsoleTerminal(), parent) {
+                m_owns_terminal = true;
+            }
+
+            // a view of `terminal`, which outlives the widget
+            QonsoleWidget(QonsoleTerminal *terminal, QWidget *parent) : QWidget(parent), m_term(terminal) {
+                set_font(QFont("Monospace", 14));
+
+                connect(m_term, &QonsoleTerminal::updated, this, &QonsoleWidget::schedule_frame);
+                connect(m_term, &QonsoleTerminal::resized, this, &QonsoleWidget::on_resized);
+                connect(m_term, &QonsoleTerminal::screen_reset, this, &QonsoleWidget::on_screen_reset);
+                connect(m_term, &QonsoleTerminal::write_congested, this, &QonsoleWidget::write_congested);
+
+                m_history_seen = m_term->m_history_migrated;
+
+                // assuming it is a free widget
+                if (!parent) {
+                    widget_fit_vt_size();
+                }
+
+                setFocusPolicy(Qt::FocusPolicy::StrongFocus);
+                setMouseTracking(true);
+
+                m_frame_timer.setSingleShot(true);
+                m_frame_timer.setTimerType(Qt::PreciseTimer);
+                connect(&m_frame_timer, &QTimer::timeout, this, &QonsoleWidget::present_frame);
+
+                m_scroll_timer.setTimerType(Qt::PreciseTimer);
+                connect(&m_scroll_timer, &QTimer::timeout, this, &QonsoleWidget::scroll_step);
+
+                m_resize_timer.setSingleShot(true);
+                m_resize_timer.setInterval(RESIZE_DEBOUNCE_TIME);
+                connect(&m_resize_timer, &QTimer::timeout, this, &QonsoleWidget::apply_resize);
+
+                // every exposed pixel is painted, which lets scroll() blit
+                setAttribute(Qt::WA_OpaquePaintEvent);
+
+                load_default_palette();
+            }
+
+            ~QonsoleWidget() {
+                // other views of a shared terminal keep using its reader
+                if (m_owns_terminal)
+                    emit destructed(m_term->reader);
+                else if (m_counted_view)
+                    m_term->track_view_exposure(-1, -int(m_counted_exposed));
+
+                #ifdef QONSOLE_OPENGL
+                delete m_gl;
+                m_gl = nullptr;
+                #endif
+
+                if (m_owns_terminal)
+                    delete m_term;
+                m_term = nullptr;
+            }
+
+            QonsoleTerminal* terminal() const {
+                return m_term;
+            }
+
+            // encoding of the unmodified cursor keys
+            void set_cursor_keys(q_cursor_keys mode) {
+                m_cursor_keys = mode;
+            }
+
+            // send `sequence` for `key` with `mods` instead of the keymap's bytes,
+            // an empty sequence swallows the key
+            void bind_key(int key, Qt::KeyboardModifiers mods, const QByteArray &sequence) {
+                m_key_bindings.insert(binding_key(key, mods), sequence);
+            }
+
+            void unbind_key(int key, Qt::KeyboardModifiers mods) {
+                m_key_bindings.remove(binding_key(key, mods));
+            }
+
+            // send LF for Enter and BS for Backspace, as qonsole did before the
+            // keymap, instead of xterm's CR and DEL. for programs reading raw input
+            // that expect those bytes; bind_key() still takes precedence
+            void set_legacy_keys(bool enable) {
+                m_legacy_keys = enable;
+            }
+
+            // suspend the terminal while this view is hidden, minimized or occluded:
+            // output is held back and parsed in bulk, nothing is scheduled, and the
+            // view repaints in full once shown. `drop_caches` also frees the glyph
+            // cache meanwhile. a shared terminal is suspended once all the views
+            // that set this are hidden
+            void set_suspend_when_hidden(bool enable, bool drop_caches = false) {
+                m_suspend_hidden = enable;
+                m_drop_caches_hidden = drop_caches;
+
+                update_suspension();
+            }
+
+            void scroll_up(int lines = 1) {
+                stop_scroll_animation();
+                scroll_to_position((long long)(m_scroll_offset + lines) * m_char_height);
+            }
+
+            void scroll_down(unsigned int lines = 1) {
+                stop_scroll_animation();
+
+                // a partly shown line counts as one
+                int offset = m_scroll_offset + (m_scroll_pixels > 0 ? 1 : 0);
+                scroll_to_position((long long)qMax<long long>(0, (long long)offset - lines) * m_char_height);
+            }
+
+            void scroll_to_top() {
+                stop_scroll_animation();
+
+                // clamped to the oldest line kept, see scroll_limit()
+                scroll_to_position(LLONG_MAX / 2);
+            }
+
+            void scroll_to_bottom() {
+                stop_scroll_animation();
+                scroll_to_position(0);
+            }
+
+            // send `text` as pasted input, see QonsoleTerminal::paste()
+            void paste(const QString &text) {
+                if (scrolled_back())
+                    scroll_to_bottom();
+
+                reset_selection();
+                m_term->paste(text.toUtf8());
+            }
+
+            void paste_clipboard(QClipboard::Mode mode = QClipboard::Clipboard) {
+                if (QClipboard *clipboard = QGuiApplication::clipboard())
+                    paste(clipboard->text(mode));
+            }
+
+            void px2pos(QPoint p, uint &col, uint &line) {
+                col = p.x() / m_char_width;
+                line = qMax(0, p.y() - m_scroll_pixels) / m_char_height;
+            }
+
+            QPoint pos2px(uint col, uint line) {
+                return QPoint(
+                    col * m_char_width,
+                    line * m_char_height + m_scroll_pixels
+                );
+            }
+
+            void reset_selection() {
+                m_is_selecting = false;
+                m_selection = {0, 0, 0, 0, false};
+
+                update_selection_span();
+            }
+
+            void set_vt_size(uint cols, uint lines) {
+                request_resize(cols, lines);
+            }
+
+            // adjust widget size: adapt to vt size
+            void widget_fit_vt_size() {
+                if (m_term->m_screen) {
+                    resize(m_term->m_cols * m_char_width, m_term->m_lines * m_char_height);
+                }
+                else {
+                    qDebug() << "no vt screen";
+                }
+            }
+
+            // adjust vt size: adapt to widget size
+            void vt_fit_widget_size() {
+                request_resize(width() / m_char_width, height() / m_char_height);
+            }
+
+            // RESIZE_IMMEDIATE (default) resizes the terminal, and signals the program,
+            // on each set_vt_size() or vt_fit_widget_size(). the debounced modes wait
+            // until the size stayed put for RESIZE_DEBOUNCE_TIME, so a window drag costs
+            // the program a single redraw: RESIZE_CLIP keeps showing the current grid
+            // and its output, RESIZE_STRETCH scales the last frame (software rendering)
+            void set_resize_mode(q_resize_mode mode) {
+                m_resize_mode = mode;
+
+                if (mode == RESIZE_IMMEDIATE && m_resize_timer.isActive())
+                    apply_resize();
+            }
+
+            // resize the terminal now, or once the size settles
+            void request_resize(int cols, int lines) {
+                if (m_resize_mode == RESIZE_IMMEDIATE) {
+                    m_term->resize(cols, lines);
+                    return;
+                }
+
+                if (m_resize_mode == RESIZE_STRETCH && m_resize_frame.isNull())
+                    capture_resize_frame();
+
+                m_resize_pending = QSize(cols, lines);
+                m_resize_timer.start();
+
+                if (!m_resize_frame.isNull())
+                    update();
+            }
+
+
+            void set_color_palette(const q_palette plt) {
+                m_palette[0]  = plt.black;
+                m_palette[1]  = plt.red;
+                m_palette[2]  = plt.green;
+                m_palette[3]  = plt.yellow;
+                m_palette[4]  = plt.blue;
+                m_palette[5]  = plt.magenta;
+                m_palette[6]  = plt.cyan;
+                m_palette[7]  = plt.white;
+                m_palette[8]  = plt.bright_black;
+                m_palette[9]  = plt.bright_red;
+                m_palette[10] = plt.bright_green;
+                m_palette[11] = plt.bright_yellow;
+                m_palette[12] = plt.bright_blue;
+                m_palette[13] = plt.bright_magenta;
+                m_palette[14] = plt.bright_cyan;
+                m_palette[15] = plt.bright_white;
+
+                m_default_fg = m_palette[7];
+                m_default_bg = m_palette[0];
+                m_selection_bg = plt.selection_bg;
+
+                build_color_table();
+                m_last_age = 0;
+                damage();
             }
+            
+            // configure font
+            void set_font(QFont fnt) {
+                m_font = fnt;
+                update_metrics();
+                m_glyph_cache.clear();
+                m_row_hashes.clear();
+                damage();
 
-            void resize_vt() {
-                if (m_cols < 1) m_cols = 1;
-                if (m_lines < 1) m_lines = 1;
-                
-                if (m_screen) {
-                    tsm_screen_resize(m_screen, m_cols, m_lines);
-                }
+                #ifdef QONSOLE_OPENGL
+                if (m_gl)
+                    m_gl->reset_atlas(m_char_width, m_char_height);
+                #endif
+            }
 
-                // if connected to a local pty, notify the process about size change
-                #if defined(__linux__) || defined(__APPLE__)
-                if (reader && reader->file_descriptor >= 0) {
-                    struct winsize ws;
-                    ws.ws_col = m_cols;
-                    ws.ws_row = m_lines;
-                    ws.ws_xpixel = 0;
-                    ws.ws_ypixel = 0;
-                    ioctl(reader->file_descriptor, TIOCSWINSZ, &ws);
+            // draw with QPainter (default) or the OpenGL backend, false when the
+            // backend was not compiled in (define QONSOLE_OPENGL)
+            bool set_render_backend(q_render_backend backend) {
+                #ifdef QONSOLE_OPENGL
+                if (backend == OPENGL && !m_gl) {
+                    m_gl = new QonsoleGLRenderer(this);
+                    m_gl->setGeometry(rect());
+                    m_gl->show();
+                }
+                else if (backend == SOFTWARE && m_gl) {
+                    delete m_gl;
+                    m_gl = nullptr;
                 }
+
+                damage();
+                return true;
+                #else
+                return backend == SOFTWARE;
                 #endif
             }
 
-        public:
-            QonsoleWidget(QWidget*parent) : QWidget(parent) {
-                set_font(QFont("Monospace", 14));
+            // THROUGHPUT (default) coalesces everything into one frame per refresh,
+            // LATENCY additionally presents output right away shortly after a keystroke
+            void set_frame_pacing(q_frame_pacing pacing) {
+                m_pacing = pacing;
+            }
+
+            void set_cursor_style(q_cursor_style qcs) {
+                m_qcstyle = qcs;
+            }
+
+            void set_bold(bool s) {
+                m_use_bold = s;
+            }
+    
+            // for optimization, empty cells are not drawn by default
+            void set_draw_empty_cells(bool s) {
+                m_draw_empty_cells = s;
+            }
+
+            // blit cells from a cache of pre-rendered glyphs (enabled by default)
+            void set_glyph_cache(bool s) {
+                m_use_glyph_cache = s;
+                m_glyph_cache.clear();
+                damage();
+            }
+
+            // repaint only cells changed since the last frame (enabled by default),
+            // disabling it repaints the whole widget on each chunk of output
+            void set_incremental_repaint(bool s) {
+                m_incremental_repaint = s;
+                m_last_age = 0;
+                damage();
+            }
+
+            // render cells into a persistent image owned by the widget (disabled by
+            // default): only damaged cells are rendered into it, a repaint presents it
+            // with one drawImage, and the cursor and selection are drawn over it so
+            // moving either renders no glyphs. the selection tints the cells instead
+            // of replacing their background
+            void set_backing_store(bool s) {
+                m_use_backing = s;
+                m_backing = QImage();
+                m_backing_dirty = QRegion();
+                m_row_hashes.clear();
+                m_last_age = 0;
+                damage();
+            }
+
+
+            unsigned int get_scroll_position() const {
+                return m_scroll_offset;
+            }
+
+            unsigned int get_max_scroll() const {
+                if (m_term->m_history) {
+                    QMutexLocker locker(&m_term->m_tsm_lock);
+                    return m_term->m_history->line_count();
+                }
+
+                return m_term->m_max_scrollback;
+            }
+
+            // return where selection starts and ends as a flat
+            const q_selection& get_selection() {
+                return m_selection;
+            }
+
+            QString get_selected_text() {
+                return QString::fromUtf8(get_selected_text_utf8());
+            }
+
+            // selected text extracted by libtsm, which walks only the selected
+            // lines, scrollback included when the view is scrolled back
+            QByteArray get_selected_text_utf8() {
+                if (!m_is_selecting || !m_term->m_screen)
+                    return QByteArray();
+
+                uint sl = m_selection.start_line;
+                uint sc = m_selection.start_column;
+                uint el = m_selection.end_line;
+                uint ec = m_selection.end_column;
+
+                if (sl > el || (sl == el && sc > ec)) {
+                    std::swap(sl, el);
+                    std::swap(sc, ec);
+                }
+
+                // scrolled back into the budgeted scrollback, the view mixes stored
+                // lines and screen rows which libtsm knows nothing about
+                if (m_term->m_history && m_scroll_offset > 0) {
+                    q_dump_grid grid;
+                    view_grid(grid);
+
+                    return utils::to_utf8(QonsoleTerminal::grid_text(grid, sl, sc, el, ec));
+                }
+
+                char *out = nullptr;
+
+                // the libtsm selection only lives for the copy, a live one makes
+                // tsm_screen_draw invert the selected cells on top of our own highlight
+                QMutexLocker locker(&m_term->m_tsm_lock);
+                sync_view_scroll();
+                tsm_screen_selection_start(m_term->m_screen, sc, sl);
+                tsm_screen_selection_target(m_term->m_screen, ec, el);
+                int len = tsm_screen_selection_copy(m_term->m_screen, &out);
+                tsm_screen_selection_reset(m_term->m_screen);
+                locker.unlock();
+
+                QByteArray text;
+                if (len > 0 && out)
+                    text = QByteArray(out, len);
+
+                free(out);
+                return text;
+            }
+
+            // fill grid with the rows currently shown, scrollback lines included
+            void view_grid(q_dump_grid &grid) {
+                grid = q_dump_grid();
+
+                if (!m_term->m_screen)
+                    return;
+
+                QMutexLocker locker(&m_term->m_tsm_lock);
+
+                q_dump_grid screen;
+                screen.width = tsm_screen_get_width(m_term->m_screen);
+                screen.height = tsm_screen_get_height(m_term->m_screen);
+                screen.cells.assign(static_cast<size_t>(screen.width) * screen.height, U' ');
+
+                sync_view_scroll();
+                tsm_screen_draw(m_term->m_screen, QonsoleTerminal::dump_callback, &screen);
+
+                unsigned int shift = m_term->m_history ? qMin<unsigned int>(m_scroll_offset, screen.height) : 0;
+
+                if (shift == 0) {
+                    grid = std::move(screen);
+                    return;
+                }
+
+                grid.width = screen.width;
+                grid.height = screen.height;
+                grid.cells.assign(screen.cells.size(), U' ');
+
+                for_each_history_cell(m_scroll_offset, shift, [&](const uint32_t *ch, size_t len, unsigned int width,
+                                                 unsigned int col, unsigned int row, const tsm_screen_attr *attr) {
+                    Q_UNUSED(attr);
+
+                    if (col >= grid.width)
+                        return;
+
+                    size_t index = static_cast<size_t>(row) * grid.width + col;
+                    grid.cells[index] = len > 0 ? ch[0] : U' ';
+
+                    if (len > 1) {
+                        grid.extra.emplace_back(index, std::u32string(
+                            reinterpret_cast<const char32_t*>(ch) + 1,
+                            reinterpret_cast<const char32_t*>(ch) + len
+                        ));
+                    }
+
+                    if (width > 1 && col + 1 < grid.width)
+                        grid.cells[static_cast<size_t>(row) * grid.width + col + 1] = 0;
+                });
+
+                // the screen is pushed down by the scrollback rows
+                size_t offset = static_cast<size_t>(shift) * grid.width;
+                size_t kept = grid.cells.size() - offset;
+
+                std::copy(screen.cells.begin(), screen.cells.begin() + kept, grid.cells.begin() + offset);
+
+                for (const auto &extra : screen.extra) {
+                    if (extra.first < kept)
+                        grid.extra.emplace_back(extra.first + offset, extra.second);
+                }
+            }
+
+            // look for `pattern` in the scrollback and on the screen, from the last
+            // match towards newer lines, or older ones when `backward`. a match is
+            // scrolled into view and highlighted, the selection is left alone. a new
+            // search starts from the newest line when going backward, from the
+            // oldest otherwise
+            bool find_next(const QString &pattern, bool backward = false, bool regex = false, bool case_sensitive = true) {
+                if (!m_term->m_screen || pattern.isEmpty())
+                    return false;
+
+                q_search_pattern search(pattern, regex, case_sensitive);
+                if (!search.valid())
+                    return false;
+
+                QByteArray needle = search.needle();
+
+                QMutexLocker locker(&m_term->m_tsm_lock);
+
+                // lines above the screen: the budgeted scrollback, or libtsm's own
+                // which is only reachable as selected text
+                size_t above;
+                quint64 base = 0;
+                QList<QByteArray> tsm_lines;
+
+                if (m_term->m_history) {
+                    m_term->migrate_history();
+                    m_history_seen = m_term->m_history_migrated;
+
+                    above = m_term->m_history->line_count();
+                    base = m_term->m_history->dropped_lines();
+                }
+                else {
+                    tsm_lines = m_term->scrollback_lines();
+                    above = tsm_lines.size();
+                    base = m_term->m_sb_pushed - above;
+                }
+
+                q_dump_grid grid;
+                grid.width = tsm_screen_get_width(m_term->m_screen);
+                grid.height = tsm_screen_get_height(m_term->m_screen);
+                grid.cells.assign(static_cast<size_t>(grid.width) * grid.height, U' ');
+
+                tsm_screen_draw(m_term->m_screen, QonsoleTerminal::dump_callback, &grid);
+
+                long long total = above + grid.height;
+                long long line = backward ? total - 1 : 0;
+                int column = backward ? INT_MAX : -1;
+
+                if (m_last_match.valid && m_last_match.line >= base && m_last_match.line - base < (quint64)total) {
+                    line = m_last_match.line - base;
+                    column = m_last_match.start_column;
+                }
+
+                size_t loaded = SIZE_MAX;
+                std::vector<QByteArray> block_text;
+                std::vector<std::pair<int, int>> hits;
+                std::vector<int> columns;
+
+                for (; line >= 0 && line < total; line += backward ? -1 : 1, column = backward ? INT_MAX : -1) {
+                    QByteArray text;
+
+                    if ((size_t)line < above && m_term->m_history) {
+                        size_t block = line / HISTORY_BLOCK_LINES;
+
+                        if (block != loaded) {
+                            // the trigram filter rules out whole blocks for literals
+                            if (!needle.isEmpty() && !m_term->m_history->may_contain(block, needle)) {
+                                line = backward ? (long long)block * HISTORY_BLOCK_LINES
+                                                : (long long)(block + 1) * HISTORY_BLOCK_LINES - 1;
+                                continue;
+                            }
+
+                            block_text.assign(HISTORY_BLOCK_LINES, QByteArray());
+                            m_term->m_history->scan_block(block, [&](size_t index, const char *data, size_t len) {
+                                block_text[index % HISTORY_BLOCK_LINES] = QByteArray(data, static_cast<int>(len));
+                            });
+                            loaded = block;
+                        }
+
+                        text = block_text[line % HISTORY_BLOCK_LINES];
+                    }
+                    else if ((size_t)line < above) {
+                        text = tsm_lines[line];
+                    }
+                    else {
+                        // screen rows, the continuation of wide cells left out
+                        size_t row = (line - above) * grid.width;
+                        for (size_t i = row; i < row + grid.width; ++i) {
+                            if (grid.cells[i])
+                                utils::append_utf8(text, grid.cells[i]);
+                        }
+                    }
+
+                    search.find(text.constData(), text.size(), hits);
+                    if (hits.empty())
+                        continue;
+
+                    // column of each codepoint, plus the column past the last one
+                    columns.clear();
+
+                    if ((size_t)line < above && m_term->m_history) {
+                        q_history_line cells;
+                        m_term->m_history->line(line, cells);
+
+                        // every codepoint of a cell maps to the cell's column
+                        int col = 0;
+                        cells.for_each_cell([&](const char32_t *ch, size_t len, const q_history_run &run) {
+                            Q_UNUSED(ch);
+                            columns.insert(columns.end(), len, col);
+                            col += run.width;
+                        });
+                        columns.push_back(col);
+                    }
+                    else if ((size_t)line < above) {
+                        // the copied text holds the cells' codepoints, wide ones
+                        // take two columns and combining marks share the previous one
+                        int col = 0;
+
+                        for (int i = 0; i < text.size(); ) {
+                            uchar lead = text[i];
+                            int follow = lead >= 0xF0 ? 3 : lead >= 0xE0 ? 2 : lead >= 0xC0 ? 1 : 0;
+                            char32_t c = follow ? lead & (0x3F >> follow) : lead;
+
+                            for (int k = 1; k <= follow && i + k < text.size(); ++k)
+                                c = (c << 6) | (text[i + k] & 0x3F);
+
+                            columns.push_back(col);
+                            col += qMax(0, static_cast<int>(tsm_ucs4_get_width(c)));
+                            i += follow + 1;
+                        }
+                        columns.push_back(col);
+                    }
+                    else {
+                        size_t row = (line - above) * grid.width;
+                        for (unsigned int i = 0; i < grid.width; ++i) {
+                            if (grid.cells[row + i])
+                                columns.push_back(i);
+                        }
+                        columns.push_back(grid.width);
+                    }
+
+                    const std::pair<int, int> *hit = nullptr;
+
+                    for (const std::pair<int, int> &h : hits) {
+                        if ((size_t)(h.first + h.second) >= columns.size())
+                            break;
+
+                        int start = columns[h.first];
+
+                        if (backward ? start < column : start > column) {
+                            hit = &h;
+
+                            if (!backward)
+                                break;
+                        }
+                    }
+
+                    if (!hit)
+                        continue;
 
-                // Initialize libtsm
-                int ret = tsm_screen_new(&m_screen, nullptr, nullptr);
-                if (ret < 0) {
-                    qWarning() << "Failed to create tsm screen";
-                    return;
-                }
+                    m_last_match.line = base + line;
+                    m_last_match.start_column = columns[hit->first];
+                    m_last_match.end_column = columns[hit->first + hit->second] - 1;
+                    m_last_match.valid = true;
 
-                // set scrollback buffer size (IMPORTANT!)
-                tsm_screen_set_max_sb(m_screen, m_max_scrollback);
+                    // bring the line into view, about halfway up when it is above the screen
+                    int row = line - above;
+                    int offset = 0;
 
-                ret = tsm_vte_new(&m_vte, m_screen, write_callback, this, nullptr, nullptr);
-                if (ret < 0) {
-                    qWarning() << "Failed to create tsm vte";
-                    tsm_screen_unref(m_screen);
-                    m_screen = nullptr;
-                    return;
-                }
+                    if (row < 0) {
+                        offset = qMin<long long>(above, (long long)above - line + m_term->m_lines / 2);
+                        row = line - (long long)above + offset;
+                    }
 
-                // assuming it is a free widget
-                if (!parent) {
-                    set_vt_size(80, 24);
-                    widget_fit_vt_size();
+                    locker.unlock();
+
+                    stop_scroll_animation();
+                    m_scroll_offset = offset;
+                    m_scroll_pixels = 0;
+
+                    m_match_shown = true;
+                    m_last_age = 0;
+                    damage();
+
+                    return true;
                 }
 
-                setFocusPolicy(Qt::FocusPolicy::StrongFocus);
-                setMouseTracking(true);
+                return false;
+            }
 
-                load_default_palette();
+            // forget the last match and its highlight, the next search starts over
+            void clear_search() {
+                if (m_match_shown) {
+                    m_last_age = 0;
+                    damage();
+                }
+
+                m_last_match = q_search_match();
+                m_match_shown = false;
             }
 
-            ~QonsoleWidget() {
-                emit destructed(reader);
+            // background of the match find_next() highlights, blended like the
+            // selection's when translucent
+            void set_match_color(const QColor &color) {
+                m_match_bg = color;
+                build_color_table();
 
-                if (m_vte) {
-                    tsm_vte_unref(m_vte);
-                    m_vte = nullptr;
-                }
-                if (m_screen) {
-                    tsm_screen_unref(m_screen);
-                    m_screen = nullptr;
+                if (m_match_shown) {
+                    m_last_age = 0;
+                    damage();
                 }
+            }
 
-                // reader not deleted, as its set from outside so user must handle that.
+            // the terminal's API, kept on the widget for existing users
+
+            ssize_t write_to_source(const QByteArray& data) {
+                return m_term->write_to_source(data);
             }
 
+            size_t pending_write_bytes() const {
+                return m_term->pending_write_bytes();
+            }
 
-            void scroll_up(int lines = 1) {
-                if (!m_screen)
-                    return;
-                
-                tsm_screen_sb_up(m_screen, lines);
-                m_scroll_offset += lines;
-                
-                update();
+            void set_async_write(bool s) {
+                m_term->set_async_write(s);
             }
 
-            void scroll_down(unsigned int lines = 1) {
-                if (!m_screen)
-                    return;
-                
-                // Only scroll down if we're actually scrolled back
-                if (m_scroll_offset > 0) {
-                    // Don't scroll past the bottom
-                    unsigned int actual_lines = (lines > m_scroll_offset) ? m_scroll_offset : lines;
-                    
-                    tsm_screen_sb_down(m_screen, actual_lines);
-                    m_scroll_offset -= actual_lines;
-                }
-                
-                update();
+            void set_reader(QonsoleReader* r) {
+                m_term->set_reader(r);
             }
 
-            void scroll_to_top() {
-                if (!m_screen)
-                    return;
-                
-                // Scroll up by a very large amount to reach the top
-                // libtsm will automatically clamp to the actual buffer size
-                tsm_screen_sb_up(m_screen, m_max_scrollback);
-                m_scroll_offset = m_max_scrollback; // Track approximate position
-                update();
+            void set_threaded_parsing(bool s) {
+                m_term->set_threaded_parsing(s);
             }
 
-            void scroll_to_bottom() {
-                if (!m_screen)
-                    return;
-                    
-                tsm_screen_sb_reset(m_screen);
+            void set_max_scrollback(unsigned int lines) {
+                m_term->set_max_scrollback(lines);
+            }
+
+            void set_scrollback_budget(size_t bytes, bool compress = true) {
+                m_term->set_scrollback_budget(bytes, compress);
+
+                stop_scroll_animation();
                 m_scroll_offset = 0;
-                update();
+                m_scroll_pixels = 0;
+                damage();
             }
 
-            void px2pos(QPoint p, uint &col, uint &line) {
-                col = p.x() / m_char_width;
-                line = p.y() / m_char_height;
+            void set_scrollback_spill(bool enable, const QString &dir = QString(), size_t disk_budget = 0) {
+                m_term->set_scrollback_spill(enable, dir, disk_budget);
+
+                QMutexLocker locker(&m_term->m_tsm_lock);
+                if (m_term->m_history && m_scroll_offset >= (int)m_term->m_history->line_count()) {
+                    m_scroll_offset = m_term->m_history->line_count();
+                    m_scroll_pixels = 0;
+                }
             }
 
-            QPoint pos2px(uint col, uint line) {
-                return QPoint(
-                    col * m_char_width,
-                    line * m_char_height
-                );
+            size_t get_scrollback_disk_usage() const {
+                return m_term->get_scrollback_disk_usage();
             }
 
-            void reset_selection() {
-                m_is_selecting = false;
-                m_selection = {0, 0, 0, 0, false};
+            size_t get_scrollback_memory() const {
+                return m_term->get_scrollback_memory();
             }
 
-            // write to source fd/handle
-            ssize_t write_to_source(const QByteArray& data) {
-                #if defined(__linux__) || defined(__APPLE__)
-                    if (reader && reader->file_descriptor > 0) {
-                        ssize_t bytes_written = write(
-                            reader->file_descriptor, data.constData(), data.size()
-                        );
-                        return bytes_written;
-                    }
-                #elif defined(_WIN32)
-                    if (reader) {
-                        if (reader->is_socket) {
-                            // write to socket
-                            int bytes_sent = send(reader->socket, data.constData(), data.size(), 0);
-                            return bytes_sent;
-                        } else {
-                            // write to handle (pipe/file)
-                            DWORD bytes_written = 0;
-                            if (WriteFile(reader->handle, data.constData(), data.size(), &bytes_written, nullptr)) {
-                                return bytes_written;
-                            }
-                        }
-                    }
-                #endif
-                return -1; // error
+            void get_terminal_size(int& cols, int& lines) {
+                m_term->get_terminal_size(cols, lines);
             }
 
-            void set_vt_size(uint cols, uint lines) {
-                m_cols = cols;
-                m_lines = lines;
+            QString dump_screen() {
+                return m_term->dump_screen();
+            }
 
-                resize_vt();
+            QByteArray dump_screen_utf8() {
+                return m_term->dump_screen_utf8();
             }
 
-            // adjust widget size: adapt to vt size
-            void widget_fit_vt_size() {
-                if (m_screen) {
-                    resize(m_cols * m_char_width, m_lines * m_char_height);
-                }
-                else {
-                    qDebug() << "no vt screen";
-                }
+            void dump_grid(q_dump_grid &grid) {
+                m_term->dump_grid(grid);
             }
 
-            // adjust vt size: adapt to widget size
-            void vt_fit_widget_size() {
-                m_cols = width() / m_char_width;
-                m_lines = height() / m_char_height;
+            bool set_trace_file(const QString &path) {
+                return m_term->set_trace_file(path);
+            }
 
-                resize_vt();
+            bool set_record_file(const QString &path) {
+                return m_term->set_record_file(path);
             }
 
+            // runtime counters of the reader, the parser, painting and the writer
+            q_stats stats() {
+                q_stats s = m_term->stats();
 
-            void set_color_palette(const q_palette plt) {
-                m_palette[0]  = plt.black;
-                m_palette[1]  = plt.red;
-                m_palette[2]  = plt.green;
-                m_palette[3]  = plt.yellow;
-                m_palette[4]  = plt.blue;
-                m_palette[5]  = plt.magenta;
-                m_palette[6]  = plt.cyan;
-                m_palette[7]  = plt.white;
-                m_palette[8]  = plt.bright_black;
-                m_palette[9]  = plt.bright_red;
-                m_palette[10] = plt.bright_green;
-                m_palette[11] = plt.bright_yellow;
-                m_palette[12] = plt.bright_blue;
-                m_palette[13] = plt.bright_magenta;
-                m_palette[14] = plt.bright_cyan;
-                m_palette[15] = plt.bright_white;
+                s.frames = m_stats.frames;
+                s.paint_nsecs = m_stats.paint_nsecs;
+                s.last_paint_nsecs = m_stats.last_paint_nsecs;
+                s.max_paint_nsecs = m_stats.max_paint_nsecs;
+                s.cells_drawn = m_stats.cells_drawn;
+                s.cells_skipped = m_stats.cells_skipped;
 
-                m_default_fg = m_palette[7];
-                m_default_bg = m_palette[0];
-                m_selection_bg = plt.selection_bg;
-                
+                return s;
             }
+
+            // TODO: add a scroll bar, but keep it as user's option
             
-            // configure font
-            void set_font(QFont fnt) {
-                m_font = fnt;
-                update_metrics();
-            }
+    };
+    #ifdef QONSOLE_OPENGL
+    inline QonsoleGLRenderer::QonsoleGLRenderer(QonsoleWidget *owner)
+        : QOpenGLWidget(owner), m_owner(owner) {
+        // instancing and integer attributes need GL 3.3 or GLES 3.0
+        QSurfaceFormat format = QSurfaceFormat::defaultFormat();
+        if (format.renderableType() != QSurfaceFormat::OpenGLES) {
+            format.setVersion(3, 3);
+            format.setProfile(QSurfaceFormat::CoreProfile);
+        }
+        setFormat(format);
 
-            // init reader
-            void set_reader(QonsoleReader* r) {
-                this->reader = r;
+        // input stays with the terminal widget
+        setAttribute(Qt::WA_TransparentForMouseEvents);
+        setFocusPolicy(Qt::NoFocus);
+    }
+
+    inline void QonsoleGLRenderer::paintGL() {
+        m_owner->build_gl_cells(*this);
+
+        // glyphs of this frame did not fit, start the atlas over
+        if (m_atlas_full) {
+            reset_atlas(m_owner->m_char_width, m_owner->m_char_height);
+            m_owner->build_gl_cells(*this);
+        }
+
+        QColor bg = m_owner->m_default_bg;
+        qreal dpr = devicePixelRatioF();
+
+        glViewport(0, 0, qRound(width() * dpr), qRound(height() * dpr));
+        glClearColor(bg.redF(), bg.greenF(), bg.blueF(), 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        if (m_cells.empty() || !m_program || !m_program->isLinked())
+            return;
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, m_atlas);
+
+        if (m_atlas_dirty) {
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, m_atlas_image.bytesPerLine());
+            glTexImage2D(
+                GL_TEXTURE_2D, 0, GL_R8, m_atlas_image.width(), m_atlas_image.height(),
+                0, GL_RED, GL_UNSIGNED_BYTE, m_atlas_image.constBits()
+            );
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+            m_atlas_dirty = false;
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+        glBufferData(GL_ARRAY_BUFFER, m_cells.size() * sizeof(q_gl_cell), m_cells.data(), GL_STREAM_DRAW);
+
+        m_program->bind();
+        m_program->setUniformValue("u_cell", QVector2D(m_slot_width, m_slot_height));
+        m_program->setUniformValue("u_viewport", QVector2D(width() * dpr, height() * dpr));
+        m_program->setUniformValue("u_slot", QVector2D(
+            float(m_slot_width) / m_atlas_image.width(),
+            float(m_slot_height) / m_atlas_image.height()
+        ));
+        m_program->setUniformValue("u_per_row", float(m_per_row));
+        m_program->setUniformValue("u_atlas", 0);
+
+        glBindVertexArray(m_vao);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, 6, static_cast<GLsizei>(m_cells.size()));
+        glBindVertexArray(0);
+
+        m_program->release();
+    }
+    #endif // QONSOLE_OPENGL
+
+    // plays a session recording from QonsoleTerminal::set_record_file() back
+    // through the terminal's output path, at the recorded pace or as fast as it
+    // parses. seek() starts from the nearest keyframe before the target rather
+    // than from the beginning
+    class QonsoleReplay : public QObject {
+        Q_OBJECT
+
+        struct q_record {
+            q_record_type type;
+            qint64 time;  // microseconds since the recording started
+            const uchar *payload;
+            quint64 len;
+        };
+
+        struct q_keyframe {
+            qint64 time;
+            qint64 offset;  // of the keyframe record
+        };
+
+        QonsoleTerminal *m_terminal;
+        QFile m_file;
+        const uchar *m_data = nullptr;
+        qint64 m_begin = 0;  // first record
+        qint64 m_end = 0;    // past the last complete record
+
+        int m_cols = 0;  // initial size
+        int m_lines = 0;
+        qint64 m_duration = 0;
+        std::vector<q_keyframe> m_keyframes;
+
+        qint64 m_pos = 0;   // next record
+        qint64 m_time = 0;  // microseconds at the last record played
+        q_replay_speed m_speed = REAL_TIME;
+        bool m_playing = false;
+
+        // wall clock of a real time replay, started at m_origin microseconds
+        QElapsedTimer m_clock;
+        qint64 m_origin = 0;
+        QTimer m_timer;
+
+        // parse the record at `pos`, which ends the recording if it is cut short
+        bool read_record(qint64 &pos, qint64 time, q_record &record) const {
+            if (pos >= m_end)
+                return false;
+
+            const uchar *p = m_data + pos;
+            const uchar *end = m_data + m_end;
+            quint64 delta, len;
+
+            record.type = static_cast<q_record_type>(*p++);
+
+            if (!utils::get_varint(p, end, delta) || !utils::get_varint(p, end, len) || len > static_cast<quint64>(end - p))
+                return false;
+
+            record.time = time + static_cast<qint64>(delta);
+            record.payload = p;
+            record.len = len;
+
+            pos = (p - m_data) + static_cast<qint64>(len);
+            return true;
+        }
+
+        static void read_size(const q_record &record, quint64 &cols, quint64 &lines, const uchar *&rest) {
+            const uchar *end = record.payload + record.len;
+            rest = record.payload;
+
+            if (!utils::get_varint(rest, end, cols) || !utils::get_varint(rest, end, lines))
+                cols = lines = 0;
+        }
+
+        void apply(const q_record &record) {
+            quint64 cols, lines;
+            const uchar *rest;
 
-                connect(reader, &QonsoleReader::data_ready, this, &QonsoleWidget::on_data_ready);
+            switch (record.type) {
+                case RECORD_DATA:
+                    m_terminal->on_data_ready(QByteArray(reinterpret_cast<const char*>(record.payload), record.len));
+                    break;
 
-                reader->start();
+                case RECORD_RESIZE:
+                    read_size(record, cols, lines, rest);
+                    if (cols > 0 && lines > 0)
+                        m_terminal->resize(cols, lines);
+                    break;
+
+                // the screen is already in that state when playing through
+                default:
+                    break;
             }
+        }
 
-            void set_max_scrollback(unsigned int lines) {
-                m_max_scrollback = lines;
-                
-                if (m_screen) {
-                    // Tell libtsm to limit the scrollback buffer size
-                    tsm_screen_set_max_sb(m_screen, m_max_scrollback);
+        void step() {
+            QElapsedTimer budget;
+            budget.start();
+
+            while (m_playing) {
+                q_record record;
+                qint64 next = m_pos;
+
+                if (!read_record(next, m_time, record)) {
+                    m_playing = false;
+                    emit finished();
+                    return;
                 }
-            }
 
-            void set_cursor_style(q_cursor_style qcs) {
-                m_qcstyle = qcs;
-            }
+                if (m_speed == REAL_TIME) {
+                    qint64 due = record.time - (m_origin + m_clock.nsecsElapsed() / 1000);
 
-            void set_bold(bool s) {
-                m_use_bold = s;
-            }
-    
-            // for optimization, empty cells are not drawn by default
-            void set_draw_empty_cells(bool s) {
-                m_draw_empty_cells = s;
-            }
+                    if (due > 0) {
+                        m_timer.start(static_cast<int>(qMin<qint64>(due / 1000 + 1, INT_MAX)));
+                        return;
+                    }
+                }
 
+                apply(record);
+                m_pos = next;
+                m_time = record.time;
 
-            void get_terminal_size(int& cols, int& lines) {
-                cols = m_cols;
-                lines = m_lines;
+                // let frames through, a fast replay still shows its progress
+                if (budget.elapsed() >= REPLAY_TIME_BUDGET) {
+                    m_timer.start(0);
+                    return;
+                }
             }
+        }
 
-            unsigned int get_scroll_position() const {
-                return m_scroll_offset;
+        public:
+            explicit QonsoleReplay(QonsoleTerminal *terminal) : QObject(terminal), m_terminal(terminal) {
+                m_timer.setSingleShot(true);
+                m_timer.setTimerType(Qt::PreciseTimer);
+                connect(&m_timer, &QTimer::timeout, this, &QonsoleReplay::step);
             }
 
-            unsigned int get_max_scroll() const {
-                return m_max_scrollback;
-            }
+            // map the recording and index its keyframes
+            bool open(const QString &path) {
+                stop();
+                m_file.close();
+                m_keyframes.clear();
 
-            // return where selection starts and ends as a flat
-            const q_selection& get_selection() {
-                return m_selection;
-            }
+                m_file.setFileName(path);
 
-            QString get_selected_text() {
-                QString screen_dump = dump_screen();
+                if (!m_file.open(QFile::ReadOnly) || m_file.size() < 5)
+                    return false;
 
-                if (!m_is_selecting)
-                    return QString();
+                m_data = m_file.map(0, m_file.size());
 
-                const uint cols = m_cols;
+                if (!m_data || memcmp(m_data, "QREC", 4) != 0 || m_data[4] != QonsoleRecorder::version) {
+                    qWarning() << "Not a qonsole recording" << path;
+                    m_file.close();
+                    m_data = nullptr;
+                    return false;
+                }
 
-                uint sl = m_selection.start_line;
-                uint sc = m_selection.start_column;
-                uint el = m_selection.end_line;
-                uint ec = m_selection.end_column;
+                const uchar *p = m_data + 5;
+                const uchar *end = m_data + m_file.size();
+                quint64 cols, lines;
 
-                if (sl > el || (sl == el && sc > ec)) {
-                    std::swap(sl, el);
-                    std::swap(sc, ec);
+                if (!utils::get_varint(p, end, cols) || !utils::get_varint(p, end, lines)) {
+                    m_file.close();
+                    m_data = nullptr;
+                    return false;
                 }
 
-                QString result;
+                m_cols = static_cast<int>(cols);
+                m_lines = static_cast<int>(lines);
+                m_begin = p - m_data;
+                m_end = m_file.size();
 
-                for (uint line = sl; line <= el; ++line) {
-                    int line_start = line * (cols + 1);
+                q_record record;
+                qint64 pos = m_begin;
+                qint64 time = 0;
 
-                    if (line_start >= screen_dump.size())
-                        break;
+                for (qint64 at = pos; read_record(pos, time, record); at = pos) {
+                    if (record.type == RECORD_KEYFRAME)
+                        m_keyframes.push_back({record.time, at});
 
-                    uint c_start = (line == sl) ? sc : 0;
-                    uint c_end   = (line == el) ? ec : cols - 1;
+                    time = record.time;
+                }
 
-                    if (c_start > c_end)
-                        continue;
+                // a recording cut short by a crash ends at its last complete record
+                m_end = pos;
+                m_duration = time;
 
-                    int start = line_start + c_start;
-                    int len   = qMin<int>(c_end - c_start + 1,
-                                        screen_dump.size() - start);
+                seek(0);
+                return true;
+            }
 
-                    if (len > 0)
-                        result += screen_dump.mid(start, len);
+            void play(q_replay_speed speed = REAL_TIME) {
+                m_speed = speed;
+                m_playing = true;
 
-                    if (line != el)
-                        result += '\n';
-                }
+                m_origin = m_time;
+                m_clock.start();
 
-                return result;
+                m_timer.start(0);
             }
 
-            QString dump_screen() {
-                if (!m_screen) {
-                    return QString();
-                }
-                
-                unsigned int width = tsm_screen_get_width(m_screen);
-                unsigned int height = tsm_screen_get_height(m_screen);
-                
-                // pre-allocate string with estimated size
-                QString output;
-                output.reserve((width + 1) * height);
-                
-                // initialize output with spaces and newlines
-                for (unsigned int y = 0; y < height; ++y) {
-                    for (unsigned int x = 0; x < width; ++x) {
-                        output.append(' ');
+            void stop() {
+                m_playing = false;
+                m_timer.stop();
+            }
+
+            // restore the screen at `usecs` into the recording from the keyframe
+            // before it, then parse the output up to it
+            void seek(qint64 usecs) {
+                if (!m_data)
+                    return;
+
+                auto keyframe = std::upper_bound(m_keyframes.begin(), m_keyframes.end(), usecs,
+                    [](qint64 t, const q_keyframe &k) { return t < k.time; });
+
+                // a recording opens with a keyframe of the screen it started on
+                if (keyframe == m_keyframes.begin() && !m_keyframes.empty() && m_keyframes.front().offset == m_begin)
+                    ++keyframe;
+
+                m_terminal->reset(m_cols, m_lines);
+                m_pos = m_begin;
+                m_time = 0;
+
+                q_record record;
+
+                if (keyframe != m_keyframes.begin()) {
+                    --keyframe;
+
+                    qint64 next = keyframe->offset;
+                    if (read_record(next, keyframe->time, record)) {
+                        quint64 cols, lines;
+                        const uchar *rest;
+                        read_size(record, cols, lines, rest);
+
+                        if (cols > 0 && lines > 0)
+                            m_terminal->reset(cols, lines);
+
+                        m_terminal->on_data_ready(QByteArray(
+                            reinterpret_cast<const char*>(rest), record.payload + record.len - rest
+                        ));
+
+                        m_pos = next;
                     }
-                    output.append('\n');
+
+                    m_time = keyframe->time;
                 }
-                
-                // draw screen using callback
-                tsm_screen_draw(m_screen, dump_callback, &output);
-                
-                // remove trailing newline if present
-                if (output.endsWith('\n')) {
-                    output.chop(1);
+
+                for (qint64 next = m_pos; read_record(next, m_time, record) && record.time <= usecs; next = m_pos) {
+                    apply(record);
+                    m_pos = next;
+                    m_time = record.time;
                 }
-                
-                return output;
+
+                m_origin = m_time;
+                m_clock.start();
             }
 
-            // TODO: add a scroll bar, but keep it as user's option
-            
+            // microseconds
+            qint64 duration() const {
+                return m_duration;
+            }
+
+            qint64 position() const {
+                return m_time;
+            }
+
+            bool playing() const {
+                return m_playing;
+            }
+
+        signals:
+            // the last record was played
+            void finished();
     };
+
 } // end of qonsole